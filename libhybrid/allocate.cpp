@@ -0,0 +1,55 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "libhybrid/allocate.hpp"
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_NUMAIF_H) && defined(HAVE_MBIND)
+#include <numaif.h>
+#endif
+
+#define HUGE_PAGE (2*1024*1024)
+
+void *xmalloc_local(size_t bytes, const bool huge_pages, const bool bind)
+{
+#ifdef _MSC_VER
+    return xmalloc(bytes);
+#else
+    // whole pages, so madvise and mbind cover exactly this block
+    size_t align = sysconf(_SC_PAGESIZE);
+#ifdef MADV_HUGEPAGE
+    if(huge_pages && bytes >= HUGE_PAGE)
+        align = HUGE_PAGE;
+#endif
+    const size_t mod = bytes % align;
+    if(mod != 0)
+        bytes += align-mod;
+
+    void *ptr;
+    int res = posix_memalign(&ptr, align, bytes);
+    if(res)
+    {
+        fprintf(stderr, "memalign failed\n!");
+        exit(1);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if(align == HUGE_PAGE)
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+
+#if defined(HAVE_NUMAIF_H) && defined(HAVE_MBIND)
+    // preferred with no nodes is 'local': pages land on the node of whoever faults them in,
+    // whatever policy the process was started with (e.g. numactl --interleave)
+    if(bind)
+        mbind(ptr, bytes, MPOL_PREFERRED, 0, 0, 0);
+#endif
+
+    return ptr;
+#endif
+}
@@ -55,4 +55,14 @@ inline void *xmalloc(size_t bytes)
     return ptr;
 }
 #endif
+
+/** Allocate memory meant to live on the NUMA node of the calling thread.
+ *  Nothing is touched here; pages are placed when first written, so the
+ *  thread that will use the block should be the one to clear it.
+ *  \param bytes Size of the block.
+ *  \param huge_pages Ask for transparent huge pages if the block spans one.
+ *  \param bind Explicitly set a local allocation policy for the block, where mbind is available.
+ *  \returns The block, page-aligned; release with free().
+ */
+void *xmalloc_local(size_t bytes, bool huge_pages, bool bind);
 #endif
@@ -235,21 +235,74 @@ inline bool arz<T>::full_q::check() const
 }
 
 template <typename T>
-inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
-                                              const full_q &restrict q_r,
-                                              const T                    u_max,
-                                              const T                    inv_u_max)
+template <class E>
+inline void arz<T>::full_riemann_storage::wave(const int i, const T speed, const E &w)
+{
+    speeds[i] = speed;
+    waves [i] = w;
+}
+
+template <typename T>
+inline void arz<T>::full_riemann_storage::middle(const q &q_m)
+{
+    q_0 = q_m;
+}
+
+template <typename T>
+inline T arz<T>::full_riemann_storage::max_speed() const
+{
+    return std::max(std::abs(speeds[0]), std::abs(speeds[1]));
+}
+
+template <typename T>
+inline bool arz<T>::full_riemann_storage::check() const
+{
+    return xisfinite(waves[0][0])
+    && xisfinite(waves[0][1])
+    && xisfinite(waves[1][0])
+    && xisfinite(waves[1][1])
+    && xisfinite(speeds[0]) && xisfinite(speeds[1]);
+}
+
+template <typename T>
+template <class E>
+inline void arz<T>::lean_riemann_storage::wave(const int i, const T speed, const E &w)
+{
+    max_speed_ = i == 0 ? std::abs(speed) : std::max(max_speed_, std::abs(speed));
+}
+
+template <typename T>
+inline void arz<T>::lean_riemann_storage::middle(const q &q_m)
+{
+}
+
+template <typename T>
+inline T arz<T>::lean_riemann_storage::max_speed() const
+{
+    return max_speed_;
+}
+
+template <typename T>
+inline bool arz<T>::lean_riemann_storage::check() const
+{
+    return xisfinite(max_speed_);
+}
+
+template <typename T>
+template <class S>
+inline void arz<T>::basic_riemann_solution<S>::riemann(const full_q &restrict q_l,
+                                                       const full_q &restrict q_r,
+                                                       const T                    u_max,
+                                                       const T                    inv_u_max)
 {
     const full_q *fq_0;
     full_q        q_m;
 
     if(q_l.rho() < VACUUM_EPS)
     {   // case 4
-        speeds[0] = 0.0;
-        waves [0] = q(0.0, 0.0);
+        this->wave(0, 0.0, q(0.0, 0.0));
 
-        speeds[1] = q_l.u();
-        waves [1] = q_l;
+        this->wave(1, q_l.u(), q_l);
 
         q_m.clear();
         fq_0 = &q_m;
@@ -262,11 +315,10 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
         const T lambda_0_l = q_l.lambda_0(u_max);
         const T lambda_0_m = q_m.u();
 
-        speeds[0] = (lambda_0_l + lambda_0_m)/2;
-        waves [0] = q_m - q_l;
+        const T speed = (lambda_0_l + lambda_0_m)/2;
+        this->wave(0, speed, q_m - q_l);
 
-        speeds[1] = speeds[0];
-        waves [1] = q(0.0, 0.0);
+        this->wave(1, speed, q(0.0, 0.0));
 
         if(lambda_0_l > 0.0)
             fq_0 = &q_l;
@@ -278,11 +330,9 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
     }
     else if(std::abs(q_l.u() - q_r.u()) < epsilon())
     {   // case 0
-        speeds[0] = 0.0;
-        waves [0] = q(0.0, 0.0);
+        this->wave(0, 0.0, q(0.0, 0.0));
 
-        speeds[1] = q_r.u();
-        waves [1] = q_r - q_l;
+        this->wave(1, q_r.u(), q_r - q_l);
 
         fq_0 = &q_l;
     }
@@ -291,13 +341,12 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
         q_m = rho_middle(q_l, q_r, inv_u_max);
 
         const T flux_0_diff = q_m.flux_0() - q_l.flux_0();
-        speeds[0] = std::abs(flux_0_diff) < epsilon() ? 0.0 : flux_0_diff/(q_m.rho() - q_l.rho());
-        waves [0] = q_m - q_l;
+        const T speed = std::abs(flux_0_diff) < epsilon() ? 0.0 : flux_0_diff/(q_m.rho() - q_l.rho());
+        this->wave(0, speed, q_m - q_l);
 
-        speeds[1] = q_r.u();
-        waves [1] = q_r - q_m;
+        this->wave(1, q_r.u(), q_r - q_m);
 
-        fq_0 = (speeds[0] >= 0.0) ? &q_l : &q_m;
+        fq_0 = (speed >= 0.0) ? &q_l : &q_m;
     }
     else if(u_max + q_l.u() - q_l.u_eq() > q_r.u())
     {   // case 2
@@ -306,11 +355,9 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
         const T lambda0_l = q_l.lambda_0(u_max);
         const T lambda0_m = q_m.lambda_0(u_max);
 
-        speeds[0] = (lambda0_l + lambda0_m)/2;
-        waves [0] = q_m - q_l;
+        this->wave(0, (lambda0_l + lambda0_m)/2, q_m - q_l);
 
-        speeds[1] = q_r.u();
-        waves [1] = q_r - q_m;
+        this->wave(1, q_r.u(), q_r - q_m);
 
         if(lambda0_l >= 0.0)
             fq_0 = &q_l;
@@ -332,11 +379,9 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
         const T lambda0_l = q_l.lambda_0(u_max);
         const T lambda0_m = q_m.u();
 
-        speeds[0] = (lambda0_l + lambda0_m)/2;
-        waves [0] = q_m - q_l;
+        this->wave(0, (lambda0_l + lambda0_m)/2, q_m - q_l);
 
-        speeds[1] = q_r.u();
-        waves [1] = q_r - q_m;
+        this->wave(1, q_r.u(), q_r - q_m);
 
         if(lambda0_l >= 0.0)
             fq_0 = &q_l;
@@ -349,7 +394,7 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
 
     left_fluctuation  = fq_0->flux() -  q_l. flux();
     right_fluctuation =  q_r. flux() - fq_0->flux();
-    q_0               = arz<float>::q(fq_0->rho(), fq_0->y());
+    this->middle(arz<float>::q(fq_0->rho(), fq_0->y()));
 }
 
 //     const full_q q_m_r(eq::inv_u_eq(q_r.u() - q_l.u() + q_l.u_eq(), 1.0f/u_max_r, inv_gamma),
@@ -376,10 +421,11 @@ inline void arz<T>::riemann_solution::riemann(const full_q &restrict q_l,
 // };
 
 template <typename T>
-inline void arz<T>::riemann_solution::lebaque_inhomogeneous_riemann(const full_q &restrict q_l,
-                                                                    const full_q &restrict q_r,
-                                                                    const float u_max_l,
-                                                                    const float u_max_r)
+template <class S>
+inline void arz<T>::basic_riemann_solution<S>::lebaque_inhomogeneous_riemann(const full_q &restrict q_l,
+                                                                             const full_q &restrict q_r,
+                                                                             const float u_max_l,
+                                                                             const float u_max_r)
 {
     const T rho_m = std::min(static_cast<float>(1.0), eq::inv_u_eq(q_r.u() - q_l.u() + q_l.u_eq(), 1.0f/u_max_r));
 
@@ -438,21 +484,21 @@ inline void arz<T>::riemann_solution::lebaque_inhomogeneous_riemann(const full_q
     clear();
 
     const T rho_diff = q_m_l.rho() - q_l.rho();
-    speeds[0]        = std::abs(rho_diff) < 100*epsilon() ? 0.0 : (q_m_l.flux_0() - q_l.flux_0())/rho_diff;
-    waves [0]        = q_m_l - q_l;
+    const T speed    = std::abs(rho_diff) < 100*epsilon() ? 0.0 : (q_m_l.flux_0() - q_l.flux_0())/rho_diff;
+    this->wave(0, speed, q_m_l - q_l);
 
-    speeds[1]           = q_r.u();
-    waves [1]           = q_r - q_m_r;
+    this->wave(1, q_r.u(), q_r - q_m_r);
 
     left_fluctuation  = q_m_l.flux() - q_l.flux();
     right_fluctuation = q_r.flux()   - q_m_r.flux();
-    q_0               = arz<float>::q(q_m_r.rho(), q_m_r.y()); // choice of right value is (fairly) arbitrary
+    this->middle(arz<float>::q(q_m_r.rho(), q_m_r.y())); // choice of right value is (fairly) arbitrary
 };
 
 template <typename T>
-inline void arz<T>::riemann_solution::starvation_riemann(const full_q &restrict q_r,
-                                                         const T                    u_max,
-                                                         const T                    inv_u_max)
+template <class S>
+inline void arz<T>::basic_riemann_solution<S>::starvation_riemann(const full_q &restrict q_r,
+                                                                  const T                    u_max,
+                                                                  const T                    inv_u_max)
 {
     if(q_r.rho() < VACUUM_EPS)
     {
@@ -460,19 +506,18 @@ inline void arz<T>::riemann_solution::starvation_riemann(const full_q &restrict
         return;
     }
 
-    speeds[0]         = 0.0;
-    waves [0]         = q(0.0, 0.0);
-    speeds[1]         = q_r.u();
-    waves [1]         = q_r;
+    this->wave(0, 0.0, q(0.0, 0.0));
+    this->wave(1, q_r.u(), q_r);
     left_fluctuation  = q(0.0, 0.0);
     right_fluctuation = q_r.flux();
-    q_0               = arz<float>::q(q_r.rho(), q_r.y());
+    this->middle(arz<float>::q(q_r.rho(), q_r.y()));
 }
 
 template <typename T>
-inline void arz<T>::riemann_solution::stop_riemann(const full_q &restrict q_l,
-                                                   const T                    u_max,
-                                                   const T                    inv_u_max)
+template <class S>
+inline void arz<T>::basic_riemann_solution<S>::stop_riemann(const full_q &restrict q_l,
+                                                            const T                    u_max,
+                                                            const T                    inv_u_max)
 {
     full_q q_m;
     q_m.u_eq() = q_l.u_eq() - q_l.u();
@@ -481,33 +526,30 @@ inline void arz<T>::riemann_solution::stop_riemann(const full_q &restrict q_l,
     q_m.y()    = -q_m.rho()*q_m.u_eq();
 
     const T rho_diff  = q_m.rho() - q_l.rho();
-    speeds[0]         = rho_diff < VACUUM_EPS ? 0.0 : -q_l.flux_0()/rho_diff;
-    waves [0]         = -q_l;
-    speeds[1]         = 0.0;
-    waves [1]         = q(0.0, 0.0);
+    const T speed     = rho_diff < VACUUM_EPS ? 0.0 : -q_l.flux_0()/rho_diff;
+    this->wave(0, speed, -q_l);
+    this->wave(1, 0.0, q(0.0, 0.0));
     left_fluctuation  = -q_l.flux();
     right_fluctuation = q(0.0, 0.0);
-    q_0               = arz<float>::q(0, 0);
+    this->middle(arz<float>::q(0, 0));
 }
 
 template <typename T>
-inline void arz<T>::riemann_solution::clear()
+template <class S>
+inline void arz<T>::basic_riemann_solution<S>::clear()
 {
     memset(this, 0, sizeof(*this));
 }
 
 template <typename T>
-inline bool arz<T>::riemann_solution::check() const
+template <class S>
+inline bool arz<T>::basic_riemann_solution<S>::check() const
 {
-    return xisfinite(waves[0][0])
-    && xisfinite(waves[0][1])
-    && xisfinite(waves[1][0])
-    && xisfinite(waves[1][1])
+    return S::check()
     && xisfinite(left_fluctuation[0])
     && xisfinite(left_fluctuation[1])
     && xisfinite(right_fluctuation[0])
-    && xisfinite(right_fluctuation[1])
-    && xisfinite(speeds[0]) && xisfinite(speeds[1]);
+    && xisfinite(right_fluctuation[1]);
 }
 
 #endif
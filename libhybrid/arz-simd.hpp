@@ -0,0 +1,323 @@
+#ifndef __ARZ_SIMD_HPP__
+#define __ARZ_SIMD_HPP__
+
+/**\addtogroup libarz */
+/**@{*/
+
+#include <cfloat>
+#include "libhybrid/arz.hpp"
+#include "libhybrid/simd.hpp"
+
+/** Structure-of-arrays view of a run of cells.
+ *  Holds the conserved quantities and the derived velocities of full_q as
+ *  separate streams so the Riemann sweep can load several cells at once,
+ *  plus the net fluctuation each cell receives from its two interfaces.
+ */
+struct arz_streams
+{
+    enum { nstreams = 6 }; /**< Number of floats stored per cell.*/
+
+    arz_streams() : rho(0), y(0), u(0), u_eq(0), drho(0), dy(0) {}
+
+    /** Carve nstreams streams of n floats each out of storage.
+     *  \param storage Block of at least nstreams*n floats.
+     *  \param n The number of cells in each stream.
+     */
+    arz_streams(float *storage, const size_t n)
+        : rho(storage), y(storage + n), u(storage + 2*n), u_eq(storage + 3*n),
+          drho(storage + 4*n), dy(storage + 5*n)
+    {}
+
+    /** Streams starting offset cells into these ones.
+     */
+    arz_streams offset(const size_t o) const
+    {
+        arz_streams res;
+        res.rho  = rho  + o;
+        res.y    = y    + o;
+        res.u    = u    + o;
+        res.u_eq = u_eq + o;
+        res.drho = drho + o;
+        res.dy   = dy   + o;
+        return res;
+    }
+
+    /** Load cells from q and compute u and u_eq for each, as full_q would.
+     *  \param q The cells to load.
+     *  \param n How many cells.
+     *  \param u_max The maximum speed for these cells.
+     */
+    inline void fill(const arz<float>::q *restrict q, size_t n, float u_max);
+
+    /** Rebuild the full_q of cell i.
+     */
+    inline arz<float>::full_q cell(size_t i) const;
+
+    /** Net fluctuation of cell i; the right fluctuation of interface i plus the left fluctuation of interface i+1.
+     */
+    arz<float>::q dq(const size_t i) const
+    {
+        return arz<float>::q(drho[i], dy[i]);
+    }
+
+    float *rho;
+    float *y;
+    float *u;
+    float *u_eq;
+    float *drho; /**< Net fluctuation in rho.*/
+    float *dy;   /**< Net fluctuation in y.*/
+};
+
+/** Fluctuations and speeds of the homogeneous ARZ Riemann problem for V::width interfaces at once.
+ *  Computes every case of arz<float>::riemann_solution::riemann and picks
+ *  per-lane results with masks instead of branching. The waves and middle
+ *  state are not kept; nothing on the hot path reads them.
+ *  \tparam V simd::vfloat or simd::sfloat.
+ */
+template <class V>
+struct arz_riemann_pack
+{
+    typedef typename V::mask_t M;
+
+    /** Solve the problems between left and right states; same cases as riemann_solution::riemann.
+     */
+    inline void riemann(const V &rho_l, const V &y_l, const V &u_l, const V &u_eq_l,
+                        const V &rho_r, const V &y_r, const V &u_r,
+                        const V &u_max, const V &inv_u_max);
+
+    V left_fluctuation[2];   /**< Storage for the left-going fluctuation.*/
+    V right_fluctuation[2];  /**< Storage for the right-going fluctuation.*/
+    V speeds[2];             /**< Storage for the two speeds.*/
+};
+
+/** Turn summed car coverage into cell states, in place.
+ *  On entry s.rho holds the fraction of each cell covered by cars and s.y
+ *  the coverage-weighted sum of their velocities; on exit they hold the
+ *  fixed-up (rho, y) of each cell, as lane::fill_y would compute.
+ *  \param s The streams; only rho and y are touched.
+ *  \param n How many cells.
+ *  \param u_max The maximum speed for these cells.
+ */
+inline void arz_fill_y(const arz_streams &s, size_t n, float u_max);
+
+/** Solve the homogeneous interfaces [begin, end) of a lane and accumulate their fluctuations into s.drho, s.dy.
+ *  Interface i lies between cells i-1 and i of s. Cell i-1 gets the left
+ *  fluctuation of interface i added; cell i is overwritten with its right
+ *  fluctuation. So on entry cell begin-1 must hold the right fluctuation of
+ *  interface begin-1, and on exit cell end-1 still lacks the left
+ *  fluctuation of interface end.
+ *  \returns The maximum absolute wave speed seen.
+ */
+inline float arz_fluctuation_sweep(const arz_streams &s,
+                                   size_t             begin,
+                                   size_t             end,
+                                   float              u_max,
+                                   float              inv_u_max);
+/**@}*/
+
+template <class V>
+inline void arz_fill_velocities(const arz_streams &s, const size_t i, const V &u_max)
+{
+    const V rho  = V::load(s.rho + i);
+    const V y    = V::load(s.y   + i);
+    const V u_eq = u_max*(V(1.0f) - simd::sqrt(rho));
+    const V u    = simd::select(rho <= V(FLT_EPSILON),
+                                u_max,
+                                simd::max(y/rho + u_eq, V(0.0f)));
+    u_eq.store(s.u_eq + i);
+    u   .store(s.u    + i);
+}
+
+inline void arz_streams::fill(const arz<float>::q *restrict q, const size_t n, const float u_max)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        rho[i] = q[i][0];
+        y  [i] = q[i][1];
+    }
+
+    const simd::vfloat v_u_max(u_max);
+    size_t i = 0;
+    for(; i + simd::vfloat::width <= n; i += simd::vfloat::width)
+        arz_fill_velocities(*this, i, v_u_max);
+    for(; i < n; ++i)
+        arz_fill_velocities(*this, i, simd::sfloat(u_max));
+}
+
+template <class V>
+inline void arz_fill_y_block(const arz_streams &s, const size_t i, const V &u_max)
+{
+    const V zero(0.0f);
+    const V eps(arz<float>::epsilon());
+
+    const V rho   = V::load(s.rho + i);
+    const V sum_y = V::load(s.y   + i);
+    const V u     = simd::select(rho > zero, sum_y/rho, sum_y);
+    const V y     = rho*(u - u_max*(V(1.0f) - simd::sqrt(rho)));
+
+    // q::fix()
+    const typename V::mask_t empty = rho <= eps;
+    simd::select(empty, zero, simd::min(rho, V(1.0f) - eps)).store(s.rho + i);
+    simd::select(empty | (y > -eps), zero, y)                .store(s.y   + i);
+}
+
+inline void arz_fill_y(const arz_streams &s, const size_t n, const float u_max)
+{
+    const simd::vfloat v_u_max(u_max);
+    size_t i = 0;
+    for(; i + simd::vfloat::width <= n; i += simd::vfloat::width)
+        arz_fill_y_block(s, i, v_u_max);
+    for(; i < n; ++i)
+        arz_fill_y_block(s, i, simd::sfloat(u_max));
+}
+
+inline arz<float>::full_q arz_streams::cell(const size_t i) const
+{
+    arz<float>::full_q res;
+    res.rho()  = rho[i];
+    res.y()    = y[i];
+    res.u()    = u[i];
+    res.u_eq() = u_eq[i];
+    return res;
+}
+
+template <class V>
+inline void arz_riemann_pack<V>::riemann(const V &rho_l, const V &y_l, const V &u_l, const V &u_eq_l,
+                                         const V &rho_r, const V &y_r, const V &u_r,
+                                         const V &u_max, const V &inv_u_max)
+{
+    const V zero(0.0f);
+    const V eps(arz<float>::epsilon());
+
+    const V lambda0_l = u_l + simd::select(rho_l < eps, zero, rho_l*((-u_max*V(GAMMA))/simd::sqrt(rho_l)));
+
+    // centered rarefaction from the left state
+    const V cr_u      = V(GAMMA)*(u_l + u_max - u_eq_l)/V(GAMMA+1);
+    const V cr_u_eq   = u_max - cr_u/(u_max*V(GAMMA));
+    const V cr_rho    = (u_max - cr_u_eq)*(u_max - cr_u_eq);
+    const V cr_y      = cr_rho*(cr_u - cr_u_eq);
+
+    // rho_middle
+    const V m_u_eq    = u_r - u_l + u_eq_l;
+    const V m_base    = V(1.0f) - m_u_eq*inv_u_max;
+    const V m_rho     = m_base*m_base;
+    const V m_y       = m_rho*(u_r - m_u_eq);
+    const V lambda0_m = u_r + simd::select(m_rho < eps, zero, m_rho*((-u_max*V(GAMMA))/simd::sqrt(m_rho)));
+
+    // case 3 is the fall-through; build it and overwrite with the earlier cases
+    V fq_rho, fq_y, fq_u;
+    {
+        const M left = lambda0_l >= zero;
+        speeds[0]   = (lambda0_l + (u_max + u_l - u_eq_l))*V(0.5f);
+        speeds[1]   = u_r;
+        fq_rho      = simd::select(left, rho_l, cr_rho);
+        fq_y        = simd::select(left, y_l,   cr_y);
+        fq_u        = simd::select(left, u_l,   cr_u);
+    }
+
+    // case 2
+    {
+        const M c    = u_max + u_l - u_eq_l > u_r;
+        const M left = lambda0_l >= zero;
+        const M mid  = (!left) & (lambda0_m < zero);
+        const V s0   = (lambda0_l + lambda0_m)*V(0.5f);
+        speeds[0]    = simd::select(c, s0,           speeds[0]);
+        fq_rho       = simd::select(c, simd::select(left, rho_l, simd::select(mid, m_rho, cr_rho)), fq_rho);
+        fq_y         = simd::select(c, simd::select(left, y_l,   simd::select(mid, m_y,   cr_y)),   fq_y);
+        fq_u         = simd::select(c, simd::select(left, u_l,   simd::select(mid, u_r,   cr_u)),   fq_u);
+    }
+
+    // case 1
+    {
+        const M c    = u_l > u_r;
+        const V fd   = m_rho*u_r - rho_l*u_l;
+        const V s0   = simd::select(simd::abs(fd) < eps, zero, fd/(m_rho - rho_l));
+        const M left = s0 >= zero;
+        speeds[0]    = simd::select(c, s0,            speeds[0]);
+        fq_rho       = simd::select(c, simd::select(left, rho_l, m_rho), fq_rho);
+        fq_y         = simd::select(c, simd::select(left, y_l,   m_y),   fq_y);
+        fq_u         = simd::select(c, simd::select(left, u_l,   u_r),   fq_u);
+    }
+
+    // case 0
+    {
+        const M c    = simd::abs(u_l - u_r) < eps;
+        speeds[0]    = simd::select(c, zero,          speeds[0]);
+        fq_rho       = simd::select(c, rho_l,         fq_rho);
+        fq_y         = simd::select(c, y_l,           fq_y);
+        fq_u         = simd::select(c, u_l,           fq_u);
+    }
+
+    // case 5
+    {
+        const M c    = rho_r < V(VACUUM_EPS);
+        const M left = lambda0_l > zero;
+        const V s0   = (lambda0_l + simd::min(u_max, u_l + (u_max - u_eq_l)))*V(0.5f);
+        speeds[0]    = simd::select(c, s0,     speeds[0]);
+        speeds[1]    = simd::select(c, s0,     speeds[1]);
+        fq_rho       = simd::select(c, simd::select(left, rho_l, cr_rho), fq_rho);
+        fq_y         = simd::select(c, simd::select(left, y_l,   cr_y),   fq_y);
+        fq_u         = simd::select(c, simd::select(left, u_l,   cr_u),   fq_u);
+    }
+
+    // case 4
+    {
+        const M c    = rho_l < V(VACUUM_EPS);
+        speeds[0]    = simd::select(c, zero,  speeds[0]);
+        speeds[1]    = simd::select(c, u_l,   speeds[1]);
+        fq_rho       = simd::select(c, zero,  fq_rho);
+        fq_y         = simd::select(c, zero,  fq_y);
+        fq_u         = simd::select(c, zero,  fq_u);
+    }
+
+    const V fq_flux_0 = fq_rho*fq_u;
+    const V fq_flux_1 = fq_y  *fq_u;
+
+    left_fluctuation [0] = fq_flux_0 - rho_l*u_l;
+    left_fluctuation [1] = fq_flux_1 - y_l  *u_l;
+    right_fluctuation[0] = rho_r*u_r - fq_flux_0;
+    right_fluctuation[1] = y_r  *u_r - fq_flux_1;
+}
+
+template <class V>
+inline void arz_fluctuation_block(const arz_streams &s,
+                                  const size_t       i,
+                                  const V           &u_max,
+                                  const V           &inv_u_max,
+                                  V                 &maxspeed)
+{
+    arz_riemann_pack<V> pack;
+    pack.riemann(V::load(s.rho + i - 1), V::load(s.y + i - 1), V::load(s.u + i - 1), V::load(s.u_eq + i - 1),
+                 V::load(s.rho + i),     V::load(s.y + i),     V::load(s.u + i),
+                 u_max, inv_u_max);
+
+    pack.right_fluctuation[0].store(s.drho + i);
+    pack.right_fluctuation[1].store(s.dy   + i);
+    (V::load(s.drho + i - 1) + pack.left_fluctuation[0]).store(s.drho + i - 1);
+    (V::load(s.dy   + i - 1) + pack.left_fluctuation[1]).store(s.dy   + i - 1);
+
+    maxspeed = simd::max(maxspeed, simd::max(simd::abs(pack.speeds[0]), simd::abs(pack.speeds[1])));
+}
+
+inline float arz_fluctuation_sweep(const arz_streams &s,
+                                   const size_t       begin,
+                                   const size_t       end,
+                                   const float        u_max,
+                                   const float        inv_u_max)
+{
+    const simd::vfloat v_u_max(u_max);
+    const simd::vfloat v_inv_u_max(inv_u_max);
+    simd::vfloat       v_maxspeed(0.0f);
+
+    size_t i = begin;
+    for(; i + simd::vfloat::width <= end; i += simd::vfloat::width)
+        arz_fluctuation_block(s, i, v_u_max, v_inv_u_max, v_maxspeed);
+
+    simd::sfloat s_maxspeed(v_maxspeed.hmax());
+    for(; i < end; ++i)
+        arz_fluctuation_block(s, i, simd::sfloat(u_max), simd::sfloat(inv_u_max), s_maxspeed);
+
+    return s_maxspeed.hmax();
+}
+
+#endif
@@ -281,9 +281,60 @@ struct arz
                                     const full_q &restrict q_r,
                                     const T                    inv_u_max);
 
+    /** Storage policy for basic_riemann_solution that keeps the whole solution.
+     *  For debugging and plotting; records waves, speeds and the middle state.
+     */
+    struct full_riemann_storage
+    {
+        /** Record wave i and its speed. Called for wave 0, then wave 1.
+         */
+        template <class E>
+        inline void wave(const int i, const T speed, const E &w);
+
+        /** Record the state at the interface.
+         */
+        inline void middle(const q &q_m);
+
+        /** \returns The largest absolute wave speed.
+         */
+        inline T max_speed() const;
+
+        bool check() const;
+
+        q waves[2];          /**< Storage for the two solution waves.*/
+        q q_0;               /**< Storage for the middle state of this solution.*/
+        T speeds[2];         /**< Storage for the two speeds.*/
+    };
+
+    /** Storage policy for basic_riemann_solution that keeps only what stepping needs.
+     *  Waves and the middle state are dropped as they are produced; of the
+     *  speeds only the largest magnitude is kept, for the CFL condition.
+     */
+    struct lean_riemann_storage
+    {
+        /** Fold the speed of wave i into max_speed_. Called for wave 0, then wave 1.
+         */
+        template <class E>
+        inline void wave(const int i, const T speed, const E &w);
+
+        /** Discard the state at the interface.
+         */
+        inline void middle(const q &q_m);
+
+        /** \returns The largest absolute wave speed.
+         */
+        inline T max_speed() const;
+
+        bool check() const;
+
+        T max_speed_; /**< Largest absolute wave speed.*/
+    };
+
     /** Class to compute Riemann solutions for the ARZ equations.
+     *  \tparam S Storage policy; full_riemann_storage or lean_riemann_storage.
      */
-    struct riemann_solution
+    template <class S>
+    struct basic_riemann_solution : public S
     {
         /** Compute the full riemann solution, store in this instance.
          *  \param q_l The left state.
@@ -339,12 +390,17 @@ struct arz
 
         bool check() const;
 
-        q waves[2];          /**< Storage for the two solution waves.*/
         q left_fluctuation;  /**< Storage for the left-going fluctuation.*/
         q right_fluctuation; /**< Storage for the right-going fluctuation.*/
-        q q_0;               /**< Storage for the middle state of this solution.*/
-        T speeds[2];         /**< Storage for the two speeds.*/
     };
+
+    /*@{*/
+    /** \name arz_riemann Riemann solution variants.
+     *  riemann_solution keeps everything; lean_riemann_solution is for stepping.
+     */
+    typedef basic_riemann_solution<full_riemann_storage> riemann_solution;
+    typedef basic_riemann_solution<lean_riemann_storage> lean_riemann_solution;
+    /*@}*/
 };
 /**@}*/
 
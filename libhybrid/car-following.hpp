@@ -0,0 +1,266 @@
+#ifndef _CAR_FOLLOWING_HPP_
+#define _CAR_FOLLOWING_HPP_
+
+#include <cmath>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include "libhybrid/simd.hpp"
+
+namespace hybrid
+{
+    /** Parameters shared by the car-following models.
+     */
+    struct car_following_params
+    {
+        float a_max;      /**< Maximum acceleration.*/
+        float a_pref;     /**< Comfortable deceleration (positive).*/
+        float v_pref;     /**< Desired velocity.*/
+        float delta;      /**< IDM free-road exponent.*/
+        float car_length; /**< Length of a car, taken off of the rear-axle to rear-axle distance.*/
+    };
+
+    template <int N>
+    struct ipow_impl
+    {
+        template <class T>
+        static inline T eval(const T &x)
+        {
+            const T half = ipow_impl<N/2>::eval(x);
+            return (N % 2) ? half*half*x : half*half;
+        }
+    };
+
+    template <>
+    struct ipow_impl<0>
+    {
+        template <class T>
+        static inline T eval(const T &)
+        {
+            return T(1.0f);
+        }
+    };
+
+    /** x^N for a non-negative N known at compile time, by squaring.
+     *  \tparam T float, simd::sfloat or simd::vfloat.
+     */
+    template <int N, class T>
+    inline T ipow(const T &x)
+    {
+        return ipow_impl<N>::eval(x);
+    }
+
+    /** Bumper-to-bumper gap from a rear-axle to rear-axle distance, kept positive.
+     *  \tparam V simd::sfloat or simd::vfloat.
+     */
+    template <class V>
+    inline V net_gap(const V &distance, const float car_length)
+    {
+        static const float EPSILON = 10e-7;
+
+        const V len(car_length);
+        const V gap = simd::select(distance > len, distance - len, distance);
+        return simd::select(gap <= V(0.0f), V(EPSILON), gap);
+    }
+
+    inline float net_gap(const float distance, const float car_length)
+    {
+        return net_gap(simd::sfloat(distance), car_length).v;
+    }
+
+    // IDM's (v/v_pref)^delta; only the run-time exponent needs std::pow, and only works one at a time
+    template <int DELTA>
+    struct idm_free_term
+    {
+        template <class V>
+        static inline V eval(const V &ratio, float)
+        {
+            return ipow<DELTA>(ratio);
+        }
+    };
+
+    template <>
+    struct idm_free_term<0>
+    {
+        static inline simd::sfloat eval(const simd::sfloat &ratio, const float delta)
+        {
+            return std::pow(ratio.v, delta);
+        }
+    };
+
+    /** The Intelligent Driver Model.
+     *  \tparam DELTA The free-road exponent; 0 takes it from the params at
+     *  run time (with std::pow), anything else is expanded into multiplies.
+     *  Params with some other delta fall back to the run-time exponent, as
+     *  idm<0> would, one car at a time.
+     */
+    template <int DELTA>
+    struct idm
+    {
+        idm() {}
+
+        explicit idm(const car_following_params &p)
+            : a_max(p.a_max), inv_v_pref(1.0f/p.v_pref), sqrt_ab(std::sqrt(p.a_max*p.a_pref)),
+              delta(p.delta), car_length(p.car_length), runtime_delta(DELTA != 0 && p.delta != DELTA)
+        {}
+
+        /** Acceleration of followers distance behind their leaders (rear axle to rear axle).
+         *  Always uses DELTA; operator() and accelerations() check runtime_delta first.
+         *  \tparam V simd::sfloat, or simd::vfloat if DELTA isn't 0.
+         */
+        template <class V>
+        inline V eval(const V &leader_velocity, const V &follower_velocity, const V &distance) const
+        {
+            return eval_as<DELTA>(leader_velocity, follower_velocity, distance);
+        }
+
+        inline float operator()(const float leader_velocity, const float follower_velocity, const float distance) const
+        {
+            const simd::sfloat lv(leader_velocity), fv(follower_velocity), d(distance);
+            return (runtime_delta ? eval_as<0>(lv, fv, d) : eval_as<DELTA>(lv, fv, d)).v;
+        }
+
+        float a_max;
+        float inv_v_pref;
+        float sqrt_ab;
+        float delta;
+        float car_length;
+        bool  runtime_delta; /**< delta isn't DELTA, so the free term goes through std::pow.*/
+
+        template <int D, class V>
+        inline V eval_as(const V &leader_velocity, const V &follower_velocity, const V &distance) const
+        {
+            static const float s1 = 2;
+            static const float T  = 1.6;
+
+            const V optimal_spacing = V(s1) + V(T)*follower_velocity + (follower_velocity*(follower_velocity - leader_velocity))*V(0.5f)*V(sqrt_ab);
+            const V spacing_ratio   = optimal_spacing/net_gap(distance, car_length);
+
+            return V(a_max)*(V(1.0f) - idm_free_term<D>::eval(follower_velocity*V(inv_v_pref), delta) - spacing_ratio*spacing_ratio);
+        }
+    };
+
+    /** Gipps' model; the velocity it picks one reaction time ahead, as an acceleration over that time.
+     */
+    struct gipps
+    {
+        gipps() {}
+
+        explicit gipps(const car_following_params &p)
+            : a_max(p.a_max), b(p.a_pref), inv_v_pref(1.0f/p.v_pref), car_length(p.car_length)
+        {}
+
+        inline float operator()(const float leader_velocity, const float follower_velocity, const float distance) const
+        {
+            static const float tau     = 0.66f;
+            static const float inv_tau = 1.0f/tau;
+
+            const float ratio  = follower_velocity*inv_v_pref;
+            const float v_free = follower_velocity + 2.5f*a_max*tau*(1.0f - ratio)*std::sqrt(0.025f + ratio);
+            const float under  = b*b*tau*tau + b*(2.0f*net_gap(distance, car_length) - follower_velocity*tau + leader_velocity*leader_velocity/b);
+            const float v_safe = -b*tau + std::sqrt(std::max(under, 0.0f));
+
+            return (std::max(std::min(v_free, v_safe), 0.0f) - follower_velocity)*inv_tau;
+        }
+
+        float a_max;
+        float b;
+        float inv_v_pref;
+        float car_length;
+    };
+
+    /** Krauss' model without the random dawdling term; the velocity it picks one reaction time ahead, as an acceleration.
+     */
+    struct krauss
+    {
+        krauss() {}
+
+        explicit krauss(const car_following_params &p)
+            : a_max(p.a_max), inv_2b(0.5f/p.a_pref), v_pref(p.v_pref), car_length(p.car_length)
+        {}
+
+        inline float operator()(const float leader_velocity, const float follower_velocity, const float distance) const
+        {
+            static const float tau     = 1.0f;
+            static const float inv_tau = 1.0f/tau;
+
+            const float gap    = net_gap(distance, car_length);
+            const float v_safe = leader_velocity + (gap - leader_velocity*tau)/((follower_velocity + leader_velocity)*inv_2b + tau);
+            const float v_next = std::min(std::min(follower_velocity + a_max*tau, v_pref), v_safe);
+
+            return (std::max(v_next, 0.0f) - follower_velocity)*inv_tau;
+        }
+
+        float a_max;
+        float inv_2b;
+        float v_pref;
+        float car_length;
+    };
+
+    /** Accelerations of n followers at once; see the idm overload for the vectorized one.
+     *  \param model The car-following model.
+     *  \param leader_velocity Velocity of each follower's leader.
+     *  \param follower_velocity Velocity of each follower.
+     *  \param distance Rear-axle to rear-axle distance of each pair.
+     *  \param out The resulting accelerations.
+     *  \param n How many pairs.
+     */
+    template <class MODEL>
+    inline void accelerations(const MODEL &model,
+                              const float *leader_velocity,
+                              const float *follower_velocity,
+                              const float *distance,
+                              float       *out,
+                              const size_t n)
+    {
+        for(size_t i = 0; i < n; ++i)
+            out[i] = model(leader_velocity[i], follower_velocity[i], distance[i]);
+    }
+
+    template <int DELTA>
+    struct idm_batch
+    {
+        static inline size_t run(const idm<DELTA> &model,
+                                 const float      *leader_velocity,
+                                 const float      *follower_velocity,
+                                 const float      *distance,
+                                 float            *out,
+                                 const size_t      n)
+        {
+            size_t i = 0;
+            if(model.runtime_delta)
+                return i;
+            for(; i + simd::vfloat::width <= n; i += simd::vfloat::width)
+            {
+                model.eval(simd::vfloat::load(leader_velocity + i),
+                           simd::vfloat::load(follower_velocity + i),
+                           simd::vfloat::load(distance + i)).store(out + i);
+            }
+            return i;
+        }
+    };
+
+    template <>
+    struct idm_batch<0>
+    {
+        static inline size_t run(const idm<0> &, const float *, const float *, const float *, float *, size_t)
+        {
+            return 0;
+        }
+    };
+
+    /** IDM accelerations of n followers at once, simd::vfloat::width at a time when DELTA is fixed.
+     */
+    template <int DELTA>
+    inline void accelerations(const idm<DELTA> &model,
+                              const float      *leader_velocity,
+                              const float      *follower_velocity,
+                              const float      *distance,
+                              float            *out,
+                              const size_t      n)
+    {
+        for(size_t i = idm_batch<DELTA>::run(model, leader_velocity, follower_velocity, distance, out, n); i < n; ++i)
+            out[i] = model(leader_velocity[i], follower_velocity[i], distance[i]);
+    }
+}
+#endif
@@ -1,4 +1,5 @@
 #include "libhybrid/hybrid-sim.hpp"
+#include <thread>
 
 #ifdef _MSC_VER
 #include <windows.h>
@@ -19,6 +20,54 @@ namespace hybrid
         assert(N > 0);
         h = length/N;
         inv_h = 1.0f/h;
+        h_next = h;
+
+        wet_begin   = 0;
+        wet_end     = N;
+        sweep_begin = 0;
+        sweep_end   = 0;
+
+        rate     = 0.0f;
+        level    = 0;
+        flux_in  = arz<float>::q(0.0f, 0.0f);
+        flux_out = arz<float>::q(0.0f, 0.0f);
+        inflow   = arz<float>::q(0.0f, 0.0f);
+        outflow  = arz<float>::q(0.0f, 0.0f);
+    }
+
+    cell_sizing::cell_sizing()
+        : h_min(0.0f),
+          h_max(std::numeric_limits<float>::max()),
+          reference_speed(0.0f),
+          min_cells(1),
+          refine_jump(0.0f),
+          coarsen_jump(0.0f),
+          remesh_interval(50)
+    {}
+
+    float cell_sizing::initial_h(const lane &l, const float h_suggest) const
+    {
+        float res = h_suggest;
+        if(reference_speed > 0.0f)
+            res *= l.speedlimit()/reference_speed;
+
+        res = std::min(res, l.length/min_cells);
+        return std::max(h_min, std::min(res, h_max));
+    }
+
+    float cell_sizing::remesh_h(const lane &l) const
+    {
+        float jump = 0.0f;
+        for(size_t i = 1; i < l.N; ++i)
+            jump = std::max(jump, std::abs(l.q[i].rho() - l.q[i-1].rho()));
+
+        float res = l.h;
+        if(jump > refine_jump)
+            res = 0.5f*l.h;
+        else if(jump < coarsen_jump && l.N >= 2*min_cells)
+            res = 2.0f*l.h;
+
+        return std::max(h_min, std::min(res, h_max));
     }
 
     struct lane_poisson_helper
@@ -105,16 +154,18 @@ namespace hybrid
 
         current_cars().clear();
         next_cars().clear();
+        merging_in.clear();
 
-        lane_poisson_helper helper(*this, 1.0f/sim.car_length);
-        ih_poisson_t        ip(-sim.rear_bumper_offset(), helper, sim.uni);
+        lane_poisson_helper   helper(*this, 1.0f/sim.car_length);
+        simulator::rand_gen_t r(sim.rng(*this, RNG_INSTANTIATE));
+        ih_poisson_t          ip(-sim.rear_bumper_offset(), helper, &r);
 
         float candidate = ip.next();
 
         while(candidate < helper.end()-sim.front_bumper_offset())
         {
             const float position = candidate/helper.end();
-            current_cars().push_back(sim.make_car(position,
+            current_cars().push_back(sim.make_car(*this, position,
                                                   velocity(position),
                                                   0.0f));
 
@@ -133,8 +184,9 @@ namespace hybrid
     {
         typedef pproc::inhomogeneous_poisson<simulator::rand_gen_t, lane_poisson_helper> ih_poisson_t;
 
-        lane_poisson_helper helper(*this, 1.0f/sim.car_length);
-        ih_poisson_t        ip(-sim.rear_bumper_offset(), helper, sim.uni);
+        lane_poisson_helper   helper(*this, 1.0f/sim.car_length);
+        simulator::rand_gen_t r(sim.rng(*this, RNG_FIND_FIRST));
+        ih_poisson_t          ip(-sim.rear_bumper_offset(), helper, &r);
 
         const float candidate = ip.next();
         if(candidate < helper.end()-sim.front_bumper_offset())
@@ -146,12 +198,13 @@ namespace hybrid
             return false;
     }
 
-    bool lane::macro_find_last(float &param, const simulator &sim) const
+    bool lane::macro_find_last(float &param, const simulator &sim, const size_t at_step, const int substep) const
     {
         typedef pproc::inhomogeneous_poisson<simulator::rand_gen_t, lane_poisson_helper_reverse> ih_poisson_t;
 
         lane_poisson_helper_reverse helper(*this, 1.0f/sim.car_length);
-        ih_poisson_t                ip(sim.front_bumper_offset(), helper, sim.uni);
+        simulator::rand_gen_t       r(sim.rng(*this, RNG_FIND_LAST, at_step, substep));
+        ih_poisson_t                ip(sim.front_bumper_offset(), helper, &r);
 
         const float candidate = helper.end() - ip.next();
         if(candidate + sim.rear_bumper_offset() > 0)
@@ -174,14 +227,15 @@ namespace hybrid
         else
         {
             distance += length;
-            if(distance >= distance_max || parent->end->network_boundary())
+            const lane_link &ln = sim.link(*this);
+            if(distance >= distance_max || ln.end_boundary)
             {
                 vel      = 0.0f;
                 distance = distance_max;
             }
             else
             {
-                const lane *downstream = downstream_lane();
+                const lane *downstream = sim.lane_at(ln.downstream);
                 if(downstream)
                     downstream->distance_to_car(distance, vel, distance_max, sim);
                 else
@@ -222,176 +276,367 @@ namespace hybrid
         return (1.5f-local) * q_c.u() + (local-0.5f) * q_c_p.u();
     }
 
-    float lane::collect_riemann()
+    lane *lane::upstream_macro(simulator &sim)
     {
-        arz<float>::full_q  full_q_buff[2];
-        arz<float>::full_q *fq[2] = { full_q_buff, full_q_buff + 1 };
+        const lane_link &ln       = sim.link(*this);
+        const lane      *upstream = sim.lane_at(ln.upstream);
+        if(!upstream || !upstream->is_macro())
+            return 0;
 
-        const float my_speedlimit  = speedlimit();
-        const float inv_speedlimit = 1.0f/my_speedlimit;
+        lane *through = sim.lane_at(ln.upstream_through);
+        assert(through);
+        assert(!through->fictitious);
+        return through->is_macro() ? through : 0;
+    }
 
-        *fq[0] = arz<float>::full_q(q[0],
-                                    my_speedlimit);
+    lane *lane::downstream_macro(simulator &sim)
+    {
+        const lane_link &ln         = sim.link(*this);
+        const lane      *downstream = sim.lane_at(ln.downstream);
+        if(!downstream || !downstream->is_macro())
+            return 0;
 
-        float maxspeed = 0.0f;
-        lane *upstream = upstream_lane();
-        if(!upstream)
+        lane *through = sim.lane_at(ln.downstream_through);
+        assert(through);
+        assert(!through->fictitious);
+        return through->is_macro() ? through : 0;
+    }
+
+    void lane::pull_ghosts(simulator &sim)
+    {
+        // each lane reads its neighbours' end cells into its own ghosts rather than having them
+        // written in; neighbours may be at a different substep, and nothing writes q during an exchange
+        const lane *upstream = upstream_macro(sim);
+        if(upstream)
+            *up_aux = upstream->q[upstream->N-1];
+
+        const lane *downstream = downstream_macro(sim);
+        if(downstream)
+            *down_aux = downstream->q[0];
+    }
+
+    void lane::pull_flow_ghosts(simulator &sim, const int64_t t)
+    {
+        // as pull_ghosts, but from what the neighbours published for time t; lanes that
+        // don't take part in the dataflow never change, so they're read directly
+        const lane *upstream = upstream_macro(sim);
+        if(upstream)
         {
-            rs[0].starvation_riemann(*fq[0],
-                                     my_speedlimit,
-                                     inv_speedlimit);
-            maxspeed = std::max(rs[0].speeds[1], maxspeed);
+            if(upstream->active())
+                *up_aux = sim.flows[sim.lane_index(*upstream)].at(t).last;
+            else
+                *up_aux = upstream->q[upstream->N-1];
         }
-        else
-        {
-            const arz<float>::full_q us_end(*up_aux,
-                                            my_speedlimit);
 
-            if(upstream->speedlimit() == my_speedlimit)
-                rs[0].riemann(us_end,
-                              *fq[0],
-                              my_speedlimit,
-                              inv_speedlimit);
+        const lane *downstream = downstream_macro(sim);
+        if(downstream)
+        {
+            if(downstream->active())
+                *down_aux = sim.flows[sim.lane_index(*downstream)].at(t).first;
             else
-                rs[0].lebaque_inhomogeneous_riemann(us_end,
-                                                    *fq[0],
-                                                    upstream->speedlimit(),
-                                                    my_speedlimit);
-
-            maxspeed = std::max(std::max(std::abs(rs[0].speeds[0]), std::abs(rs[0].speeds[1])),
-                                maxspeed);
+                *down_aux = downstream->q[0];
         }
+    }
 
-        assert(rs[0].check());
+    void lane::pull_sent_ghosts(simulator &sim, const int parity)
+    {
+        // as pull_ghosts, but from the ends neighbours sent for this parity of substep,
+        // which nobody overwrites until the next one
+        const lane *upstream = upstream_macro(sim);
+        if(upstream)
+            *up_aux = upstream->active() ? upstream->sent_last[parity] : upstream->q[upstream->N-1];
 
-        for(size_t i = 1; i < N; ++i)
-        {
-            *fq[1] = arz<float>::full_q(q[i],
-                                        my_speedlimit);
+        const lane *downstream = downstream_macro(sim);
+        if(downstream)
+            *down_aux = downstream->active() ? downstream->sent_first[parity] : downstream->q[0];
+    }
+
+    void lane::send_ends(const int parity)
+    {
+        sent_first[parity] = q[0];
+        sent_last[parity]  = q[N-1];
+    }
 
-            rs[i].riemann(*fq[0],
-                          *fq[1],
-                          my_speedlimit,
-                          inv_speedlimit);
+    float lane::solve_upstream_end(const simulator &sim, const arz_streams &s, const arz<float>::q &ghost,
+                                   arz<float>::q &flux) const
+    {
+        const lane_link &ln             = sim.link(*this);
+        const float      my_speedlimit  = ln.speedlimit;
+        const float      inv_speedlimit = 1.0f/my_speedlimit;
 
-            assert(rs[i].check());
+        const arz<float>::full_q first(s.cell(0));
 
-            maxspeed = std::max(std::max(std::abs(rs[i].speeds[0]), std::abs(rs[i].speeds[1])),
-                                maxspeed);
-            std::swap(fq[0], fq[1]);
+        arz<float>::lean_riemann_solution rs;
+        if(ln.upstream < 0)
+        {
+            rs.starvation_riemann(first,
+                                  my_speedlimit,
+                                  inv_speedlimit);
+        }
+        else
+        {
+            // the ghost is the upstream lane's last cell, so its velocity goes by that lane's speed limit;
+            // read with ours, the wave speeds here wouldn't be the ones the upstream lane sees
+            const arz<float>::full_q us_end(ghost,
+                                            ln.upstream_speedlimit);
+
+            if(ln.upstream_speedlimit == my_speedlimit)
+                rs.riemann(us_end,
+                           first,
+                           my_speedlimit,
+                           inv_speedlimit);
+            else
+                rs.lebaque_inhomogeneous_riemann(us_end,
+                                                 first,
+                                                 ln.upstream_speedlimit,
+                                                 my_speedlimit);
         }
 
-        if(parent->end->network_boundary())
+        assert(rs.check());
+
+        s.drho[0] = rs.right_fluctuation[0];
+        s.dy[0]   = rs.right_fluctuation[1];
+        flux      = arz<float>::q(first.flux_0() - rs.right_fluctuation[0],
+                                  first.flux_1() - rs.right_fluctuation[1]);
+
+        return rs.max_speed();
+    }
+
+    float lane::solve_downstream_end(const simulator &sim, const arz_streams &s, const size_t end,
+                                     const arz<float>::q &ghost, arz<float>::q &flux) const
+    {
+        const lane_link &ln             = sim.link(*this);
+        const float      my_speedlimit  = ln.speedlimit;
+        const float      inv_speedlimit = 1.0f/my_speedlimit;
+
+        const arz<float>::full_q last(s.cell(end));
+
+        arz<float>::lean_riemann_solution rs;
+        float maxspeed = 0.0f;
+        if(ln.end_boundary)
         {
-            rs[N].clear();
+            rs.clear();
         }
         else
         {
-            lane *downstream = downstream_lane();
-            if(!downstream)
+            if(ln.downstream < 0)
             {
-                rs[N].stop_riemann(*fq[0],
-                                   my_speedlimit,
-                                   inv_speedlimit);
-                maxspeed = std::max(std::abs(rs[N].speeds[0]), maxspeed);
+                rs.stop_riemann(last,
+                                my_speedlimit,
+                                inv_speedlimit);
             }
             else
             {
-                const arz<float>::full_q ds_start(*down_aux,
-                                                  downstream->speedlimit());
-
-                if(my_speedlimit == downstream->speedlimit())
-                    rs[N].riemann(*fq[0],
-                                  ds_start,
-                                  my_speedlimit,
-                                  inv_speedlimit);
+                const arz<float>::full_q ds_start(ghost,
+                                                  ln.downstream_speedlimit);
+
+                if(my_speedlimit == ln.downstream_speedlimit)
+                    rs.riemann(last,
+                               ds_start,
+                               my_speedlimit,
+                               inv_speedlimit);
                 else
-                    rs[N].lebaque_inhomogeneous_riemann(*fq[0],
-                                                        ds_start,
-                                                        my_speedlimit,
-                                                        downstream->speedlimit());
-
-                maxspeed = std::max(std::max(std::abs(rs[N].speeds[0]), std::abs(rs[N].speeds[1])),
-                                    maxspeed);
+                    rs.lebaque_inhomogeneous_riemann(last,
+                                                     ds_start,
+                                                     my_speedlimit,
+                                                     ln.downstream_speedlimit);
             }
+            maxspeed = rs.max_speed();
         }
 
-        assert(rs[N].check());
+        assert(rs.check());
+
+        s.drho[end] += rs.left_fluctuation[0];
+        s.dy[end]   += rs.left_fluctuation[1];
+        flux         = arz<float>::q(last.flux_0() + rs.left_fluctuation[0],
+                                     last.flux_1() + rs.left_fluctuation[1]);
 
         return maxspeed;
     }
 
-    void lane::update(const float dt, simulator &sim)
+    float lane::collect_riemann(simulator &sim)
     {
-        const float coefficient = dt*inv_h;
+        const lane_link &ln             = sim.link(*this);
+        const float      my_speedlimit  = ln.speedlimit;
+        const float      inv_speedlimit = 1.0f/my_speedlimit;
+
+        // vacuum next to vacuum has no fluctuations; only the wet span, a cell either side
+        // of it, and an end with a wet neighbour need solving
+        sweep_begin = (up_aux->rho()   > 0.0f || wet_begin <= 1) ? 0 : wet_begin - 1;
+        sweep_end   = (down_aux->rho() > 0.0f || wet_end + 1 >= N) ? N : wet_end + 1;
+
+        flux_in  = arz<float>::q(0.0f, 0.0f);
+        flux_out = arz<float>::q(0.0f, 0.0f);
+        if(sweep_begin >= sweep_end)
+        {
+            sweep_begin = sweep_end = 0;
+            return 0.0f;
+        }
 
-        for(size_t i = 0; i < N; ++i)
+        qs.offset(sweep_begin).fill(q + sweep_begin, sweep_end - sweep_begin, my_speedlimit);
+
+        float maxspeed = 0.0f;
+        if(sweep_begin == 0)
+            maxspeed = solve_upstream_end(sim, qs, *up_aux, flux_in);
+        else
         {
-            q[i]     -= coefficient*(rs[i].right_fluctuation + rs[i+1].left_fluctuation);
-            q[i].y() -= q[i].y()*coefficient*sim.relaxation_factor;
-            q[i].fix();
+            qs.drho[sweep_begin] = 0.0f;
+            qs.dy[sweep_begin]   = 0.0f;
         }
 
-        lane *upstream = upstream_lane();
-        if(upstream && upstream->is_macro())
+        maxspeed = std::max(arz_fluctuation_sweep(qs, sweep_begin+1, sweep_end, my_speedlimit, inv_speedlimit),
+                            maxspeed);
+
+        if(sweep_end < N)
+            return maxspeed;
+
+        return std::max(solve_downstream_end(sim, qs, N-1, *down_aux, flux_out), maxspeed);
+    }
+
+    float lane::fixed_step(const simulator &sim, arz<float>::q *restrict cells, arz_streams s, const size_t n,
+                           const bool at_start, const bool at_end, const arz<float>::q &up, const arz<float>::q &down,
+                           const float dt) const
+    {
+        // collect_riemann and update over cells [0, n), some piece of this lane's cells; a side that isn't
+        // an end of the lane lacks its outer fluctuation, and its cells go bad one further in each step
+        const float my_speedlimit  = sim.link(*this).speedlimit;
+        const float inv_speedlimit = 1.0f/my_speedlimit;
+
+        s.fill(cells, n, my_speedlimit);
+
+        arz<float>::q flux;
+        float         maxspeed = 0.0f;
+        if(at_start)
+            maxspeed = solve_upstream_end(sim, s, up, flux);
+        else
         {
-            if(upstream->fictitious)
-            {
-                lane* next_upstream = upstream->upstream_lane();
-                assert(next_upstream);
-                assert(!next_upstream->fictitious);
-                upstream = next_upstream;
-            }
-            if(upstream->is_macro())
-                *upstream->down_aux = q[N-1];
+            s.drho[0] = 0.0f;
+            s.dy[0]   = 0.0f;
         }
 
-        lane *downstream = downstream_lane();
-        if(downstream)
+        maxspeed = std::max(arz_fluctuation_sweep(s, 1, n, my_speedlimit, inv_speedlimit), maxspeed);
+
+        if(at_end)
+            maxspeed = std::max(solve_downstream_end(sim, s, n-1, down, flux), maxspeed);
+
+        const float coefficient = dt*inv_h;
+        for(size_t i = 0; i < n; ++i)
+        {
+            cells[i]     -= coefficient*s.dq(i);
+            cells[i].y() -= cells[i].y()*coefficient*sim.relaxation_factor;
+            cells[i].fix();
+        }
+
+        return maxspeed;
+    }
+
+    void lane::update(const float dt, simulator &sim, const size_t at_step, const int substep)
+    {
+        const float coefficient = dt*inv_h;
+
+        // the sweep covers every wet cell, so the new wet span is wherever it leaves density
+        wet_begin = N;
+        wet_end   = 0;
+        for(size_t i = sweep_begin; i < sweep_end; ++i)
         {
-            if(downstream->is_macro())
+            q[i]     -= coefficient*qs.dq(i);
+            q[i].y() -= q[i].y()*coefficient*sim.relaxation_factor;
+            q[i].fix();
+            if(q[i].rho() > 0.0f)
             {
-                if(downstream->fictitious)
-                {
-                    lane* next_downstream = downstream->downstream_lane();
-                    assert(next_downstream);
-                    assert(!next_downstream->fictitious);
-                    downstream = next_downstream;
-                }
-                if(downstream->is_macro())
-                    *downstream->up_aux = q[0];
+                wet_begin = std::min(wet_begin, i);
+                wet_end   = i + 1;
             }
-            else
+        }
+
+        inflow  += dt*flux_in;
+        outflow += dt*flux_out;
+
+        lane *downstream = sim.lane_at(sim.link(*this).downstream);
+        if(downstream && !downstream->is_macro())
+        {
+            float param;
+            if(macro_find_last(param, sim, at_step, substep))
             {
-                float param;
-                if(macro_find_last(param, sim))
+                car c(0, param, velocity(param), 0.0f);
+                c.compute_intersection_acceleration(sim, *this);
+                c.integrate(dt, *this, sim.hnet->lane_width);
+
+                const int cell(std::min(which_cell(c.position), static_cast<int>(N)-1));
+                assert(cell >=0);
+                q[cell] = arz<float>::q(q[cell].rho(), c.velocity, speedlimit());
+                if(c.position >= 1.0)
                 {
-                    car c(0, param, velocity(param), 0.0f);
-                    c.compute_intersection_acceleration(sim, *this);
-                    c.integrate(dt, *this, sim.hnet->lane_width);
-
-                    const int cell(std::min(which_cell(c.position), static_cast<int>(N)-1));
-                    assert(cell >=0);
-                    q[cell] = arz<float>::q(q[cell].rho(), c.velocity, speedlimit());
-                    if(c.position >= 1.0)
-                    {
-                        c.position = length*downstream->inv_length*(c.position-1.0f);
-                        assert(downstream->is_micro());
-                        downstream->next_cars().push_back(sim.make_car(c.position, c.velocity, c.acceleration));
-                    }
+                    c.position = length*downstream->inv_length*(c.position-1.0f);
+                    assert(downstream->is_micro());
+                    downstream->next_cars().push_back(sim.make_car(*this, c.position, c.velocity, c.acceleration));
+                    ++emitted;
                 }
             }
         }
     }
 
+    void lane::reflux(simulator &sim)
+    {
+        // the two sides of an interface integrated its flux separately; the finer one is kept, and
+        // the coarser one's end cell takes the difference. On a tie both sides took the same substeps
+        // with the same ghosts, so there is nothing to correct and the step is as it was without levels
+        const lane *upstream = upstream_macro(sim);
+        if(upstream && upstream->active() && upstream->level > level)
+        {
+            q[0] += (upstream->outflow - inflow)*inv_h;
+            q[0].fix();
+            mark_wet(0);
+        }
+
+        const lane *downstream = downstream_macro(sim);
+        if(downstream && downstream->active() && downstream->level > level)
+        {
+            q[N-1] -= (downstream->inflow - outflow)*inv_h;
+            q[N-1].fix();
+            mark_wet(N-1);
+        }
+    }
+
     void lane::clear_macro()
     {
         memset(q, 0, sizeof(arz<float>::q)*N);
+        wet_begin = N;
+        wet_end   = 0;
+    }
+
+    void lane::find_wet()
+    {
+        wet_begin = N;
+        wet_end   = 0;
+        for(size_t i = 0; i < N; ++i)
+        {
+            if(q[i].rho() > 0.0f)
+            {
+                wet_begin = std::min(wet_begin, i);
+                wet_end   = i + 1;
+            }
+        }
+    }
+
+    void lane::mark_wet(const size_t i)
+    {
+        if(q[i].rho() > 0.0f)
+        {
+            wet_begin = std::min(wet_begin, i);
+            wet_end   = std::max(wet_end, i + 1);
+        }
     }
 
     void lane::convert_cars(const simulator &sim)
     {
-        BOOST_FOREACH(car &c, current_cars())
+        // coverage is summed into the rho/y streams, turned into states there, then written to q
+        memset(qs.rho, 0, sizeof(float)*N);
+        memset(qs.y,   0, sizeof(float)*N);
+
+        float *restrict rho = qs.rho;
+        float *restrict y   = qs.y;
+        BOOST_FOREACH(const car &c, current_cars())
         {
             const float car_back  = c.position+sim.rear_bumper_offset()*inv_length;
             const float car_front = c.position+sim.front_bumper_offset()*inv_length;
@@ -401,84 +646,172 @@ namespace hybrid
 
             if(start_cell == end_cell)
             {
-                float coverage       = sim.car_length*inv_h;
-                q[start_cell].rho() += coverage;
-                q[start_cell].y()   += coverage*c.velocity;
+                float coverage   = sim.car_length*inv_h;
+                rho[start_cell] += coverage;
+                y[start_cell]   += coverage*c.velocity;
                 continue;
             }
 
             if(start_cell >= 0)
             {
                 float start_coverage = (start_cell+1) - car_back*N;
-                q[start_cell].rho() += start_coverage;
-                q[start_cell].y()   += start_coverage*c.velocity;
+                rho[start_cell]     += start_coverage;
+                y[start_cell]       += start_coverage*c.velocity;
             }
 
             for(int i = start_cell+1; i < end_cell-1; ++i)
             {
-                q[i].rho() = 1.0f;
-                q[i].y()   = c.velocity;
+                rho[i] = 1.0f;
+                y[i]   = c.velocity;
             }
 
             if(end_cell < static_cast<int>(N))
             {
                 float end_coverage  = car_front*N - end_cell;
-                q[end_cell].rho()  += end_coverage;
-                assert(q[end_cell].rho() <= 1.0f);
-                q[end_cell].y()    += end_coverage*c.velocity;
+                rho[end_cell]      += end_coverage;
+                assert(rho[end_cell] <= 1.0f);
+                y[end_cell]        += end_coverage*c.velocity;
             }
         }
+
+        arz_fill_y(qs, N, speedlimit());
+
+        for(size_t i = 0; i < N; ++i)
+        {
+            q[i].rho() = rho[i];
+            q[i].y()   = y[i];
+            assert(q[i].check());
+        }
+
+        find_wet();
     }
 
     void lane::fill_y()
     {
         for(size_t i = 0; i < N; ++i)
         {
-            if(q[i].rho() > 0.0)
-                q[i].y() /= q[i].rho();
-            q[i].y() = arz<float>::eq::y(q[i].rho(),
-                                         q[i].y(),
-                                         speedlimit());
-            q[i].fix();
+            qs.rho[i] = q[i].rho();
+            qs.y[i]   = q[i].y();
+        }
+
+        arz_fill_y(qs, N, speedlimit());
+
+        for(size_t i = 0; i < N; ++i)
+        {
+            q[i].rho() = qs.rho[i];
+            q[i].y()   = qs.y[i];
+            assert(q[i].check());
         }
+
+        find_wet();
+    }
+
+    size_t lane::active_cells() const
+    {
+        return (is_macro() && active() && !fictitious) ? N : 0;
     }
 
-    void worker::macro_initialize()
+    void worker::allocate(const bool huge_pages, const bool numa_bind)
     {
-        std::cout << "Allocating " << sizeof(arz<float>::q)*N <<  " bytes for " << N << " cells...";
-        q_base = (arz<float>::q *) xmalloc(sizeof(arz<float>::q)*N);
+        // each lane's cells are bracketed by its two ghost cells: [up_aux | q[0] .. q[N-1] | down_aux]
+        q_base = (arz<float>::q *) xmalloc_local(sizeof(arz<float>::q)*q_size(), huge_pages, numa_bind);
         if(!q_base)
             throw std::exception();
-        std::cout << "Done." << std::endl;
 
-        std::cout << "Allocating " << sizeof(arz<float>::riemann_solution)*(N+macro_lanes.size()) <<  " bytes for " << N+macro_lanes.size() << " riemann solutions...";
-        rs_base = (arz<float>::riemann_solution *) xmalloc(sizeof(arz<float>::riemann_solution)*(N+macro_lanes.size()));
-        if(!rs_base)
+        stream_base = (float *) xmalloc_local(arz_streams::nstreams*sizeof(float)*N, huge_pages, numa_bind);
+        if(!stream_base)
             throw std::exception();
-        std::cout << "Done." << std::endl;
 
-        memset(q_base, 0, sizeof(arz<float>::q)*N);
-        memset(rs_base, 0, sizeof(arz<float>::riemann_solution)*(N+macro_lanes.size()));
+        // first touch; called from the thread that owns this worker, so the pages land on its node
+        memset(q_base, 0, sizeof(arz<float>::q)*q_size());
+        memset(stream_base, 0, arz_streams::nstreams*sizeof(float)*N);
+    }
+
+    void worker::bind()
+    {
+        const arz_streams qs_base(stream_base, N);
 
-        size_t q_count   = 0;
-        size_t aux_count = 0;
-        size_t rs_count  = 0;
+        size_t q_count = 0;
+        size_t offset  = 0;
         BOOST_FOREACH(lane *l, macro_lanes)
         {
-            l->q         = q_base + q_count;
-            l->up_aux    = (arz<float>::q *) xmalloc(sizeof(arz<float>::q));
-            std::memset(l->up_aux, 0,sizeof(arz<float>::q));
-            l->down_aux  = (arz<float>::q *) xmalloc(sizeof(arz<float>::q));
-            std::memset(l->down_aux, 0,sizeof(arz<float>::q));
-            l->rs        = rs_base + rs_count;
-            q_count     += l->N;
-            aux_count   += 2;
-            rs_count    += l->N + 1;
+            l->up_aux   = q_base + offset;
+            l->q        = l->up_aux + 1;
+            l->down_aux = l->q + l->N;
+            l->qs       = qs_base.offset(q_count);
+            q_count    += l->N;
+            offset     += l->N + 2;
+        }
+        assert(q_count == N);
+        assert(offset == q_size());
+    }
+
+    void worker::release()
+    {
+        if(q_base)
+            free(q_base);
+        if(stream_base)
+            free(stream_base);
+        if(q_saved)
+            free(q_saved);
+        q_base      = 0;
+        stream_base = 0;
+        q_saved     = 0;
+    }
+
+    size_t worker::active_cells() const
+    {
+        size_t res = 0;
+        BOOST_FOREACH(const lane *l, macro_lanes)
+        {
+            res += l->active_cells();
+        }
+        return res;
+    }
+
+    size_t worker::bytes() const
+    {
+        return sizeof(arz<float>::q)*q_size() + arz_streams::nstreams*sizeof(float)*N;
+    }
+
+    void worker::macro_initialize(const bool huge_pages, const bool numa_bind)
+    {
+        allocate(huge_pages, numa_bind);
+        bind();
 
+        BOOST_FOREACH(lane *l, macro_lanes)
+        {
             l->fill_y();
         }
     }
 
+    // each worker's storage is allocated and first touched by the thread that will use it
+    struct worker_init_job : public thread_pool::job
+    {
+        worker_init_job(simulator &s) : sim(s)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &)
+        {
+            sim.workers[thr_id].macro_initialize(sim.huge_pages, sim.numa_bind);
+        }
+
+        simulator &sim;
+    };
+
+    struct relayout_job : public thread_pool::job
+    {
+        relayout_job(simulator &s) : sim(s)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &)
+        {
+            sim.relayout(thr_id);
+        }
+
+        simulator &sim;
+    };
+
     void simulator::macro_initialize(const float h_suggest, const float rf)
     {
         const size_t max_thr = omp_get_max_threads();
@@ -494,128 +827,1200 @@ namespace hybrid
         min_h             = std::numeric_limits<float>::max();
 
         // initialize new lanes, compute how many cells to allocate
+        std::vector<lane*> real;
         BOOST_FOREACH(lane &l, lanes)
         {
             if(l.fictitious)
                 continue;
-            l.macro_initialize(h_suggest);
+            l.macro_initialize(sizing.initial_h(l, h_suggest));
+            min_h = std::min(min_h, l.h);
+            real.push_back(&l);
+        }
+
+        std::vector<int> part;
+        if(graph_partition)
+            std::cout << "Partition cuts " << partition_lanes(real, false, workers.size(), part) << " links" << std::endl;
 
+        for(size_t i = 0; i < real.size(); ++i)
+        {
             int worker_no = 0;
-            for(size_t i = 1; i < workers.size(); ++i)
-                if(workers[i].N < workers[worker_no].N)
-                    worker_no = i;
+            if(graph_partition)
+                worker_no = part[i];
+            else
+            {
+                for(size_t w = 1; w < workers.size(); ++w)
+                    if(workers[w].N < workers[worker_no].N)
+                        worker_no = w;
+            }
 
-            workers[worker_no].N += l.N;
-            min_h                = std::min(min_h, l.h);
-            workers[worker_no].macro_lanes.push_back(&l);
+            workers[worker_no].N += real[i]->N;
+            workers[worker_no].macro_lanes.push_back(real[i]);
         }
 
         std::cout << "min_h is " << min_h << std::endl;
 
+        worker_init_job job(*this);
+        pool->run(job);
+
         int worker_no = 0;
-        BOOST_FOREACH(worker &w, workers)
+        BOOST_FOREACH(const worker &w, workers)
         {
-            w.macro_initialize();
-            std::cout << "Worker " << worker_no << " has " << w.N << " cells " << std::endl;
+            std::cout << "Worker " << worker_no << " has " << w.N << " cells in " << w.bytes() << " bytes" << std::endl;
             ++worker_no;
         }
 
         maxes = (float*)xmalloc(max_thr*MAXES_STRIDE*sizeof(float));
     }
 
-    void simulator::macro_cleanup()
+    // conservative transfer of cell averages between two uniform meshes of [0, 1]
+    static void remap_cells(arz<float>::q *dst, const size_t dst_n, const arz<float>::q *src, const size_t src_n)
     {
-        free(maxes);
+        const float inv_src_n = 1.0f/src_n;
+        const float inv_dst_n = 1.0f/dst_n;
+
+        size_t i = 0;
+        for(size_t j = 0; j < dst_n; ++j)
+        {
+            const float start = j*inv_dst_n;
+            const float end   = (j+1)*inv_dst_n;
+
+            float rho = 0.0f;
+            float y   = 0.0f;
+            for(; i < src_n; ++i)
+            {
+                const float overlap = std::min(end, (i+1)*inv_src_n) - std::max(start, i*inv_src_n);
+                if(overlap > 0.0f)
+                {
+                    rho += overlap*src[i].rho();
+                    y   += overlap*src[i].y();
+                }
+                if((i+1)*inv_src_n > end)
+                    break;
+            }
+
+            dst[j] = arz<float>::q(rho*dst_n, y*dst_n);
+            dst[j].fix();
+        }
     }
 
-    void simulator::convert_cars(const sim_t sim_mask)
+    struct lane_load_cmp
     {
-        std::vector<lane*> &thelanes = sim_mask == MICRO ? micro_lanes : macro_lanes;
-        BOOST_FOREACH(lane *l, thelanes)
+        bool operator()(const simulator::lane_stash &l, const simulator::lane_stash &r) const
         {
-            assert(l->sim_type & sim_mask);
-            if(!l->fictitious)
-                l->clear_macro();
+            const size_t l_act = l.l->active_cells();
+            const size_t r_act = r.l->active_cells();
+            if(l_act != r_act)
+                return l_act > r_act;
+            return l.l->N > r.l->N;
         }
-        BOOST_FOREACH(lane *l, thelanes)
+    };
+
+    void simulator::rebalance(const bool force)
+    {
+        if(!plan_rebalance(force))
+            return;
+
+        relayout_job job(*this);
+        pool->run(job);
+    }
+
+    bool simulator::plan_rebalance(const bool force)
+    {
+        // the previous plan has been carried out by now
+        if(relayout_pending)
         {
-            assert(l->sim_type & sim_mask);
-            if(!l->fictitious)
-                l->convert_cars(*this);
+            relayout_pending = false;
+            std::vector<arz<float>::q>().swap(stash);
+            relayout_plan.clear();
         }
-        BOOST_FOREACH(lane *l, thelanes)
+
+        const bool resize = remesh();
+        if(!rebalance_dirty && !force && !resize)
+            return false;
+        rebalance_dirty = false;
+
+        size_t total = 0;
+        size_t most  = 0;
+        BOOST_FOREACH(const worker &w, workers)
         {
-            assert(l->sim_type & sim_mask);
-            if(!l->fictitious)
-                l->fill_y();
+            const size_t act = w.active_cells();
+            total           += act;
+            most             = std::max(most, act);
         }
-    }
 
-    float simulator::macro_step(const float cfl)
-    {
-        const size_t max_thr   = omp_get_max_threads();
-        assert(max_thr == workers.size());
-        const int    num_procs = omp_get_num_procs();
-        float        maxspeed  = 0.0f;
-        float        dt;
-#pragma omp parallel
+        if(!force && !resize && most*workers.size() <= rebalance_threshold*total)
+            return false;
+
+        // stash the macro state of every lane; storage is about to move
+        std::vector<lane*> all;
+        size_t             ncells = 0;
+        BOOST_FOREACH(const worker &w, workers)
         {
-            const int thr_id           = omp_get_thread_num();
-            maxes[thr_id*MAXES_STRIDE] = 0.0f;
+            BOOST_FOREACH(lane *l, w.macro_lanes)
+            {
+                all.push_back(l);
+                ncells += l->N;
+            }
+        }
 
-#ifdef _MSC_VER
-            DWORD_PTR mask = (1 << (thr_id % num_procs));
-            if(SetThreadAffinityMask( GetCurrentThread(), mask) == 0)
-                fprintf(stderr, "Couldn't set affinity for thread %d\n", thr_id);
-
-            if(SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) == 0)
-                fprintf(stderr, "Couldn't set realtime priority for thread %d\n", thr_id);
-#else
-            cpu_set_t mask;
-            CPU_ZERO(&mask);
-            CPU_SET((thr_id % num_procs), &mask);
-
-            if(sched_setaffinity(0, sizeof(mask), &mask) == -1)
-                std::cerr << "Couldn't set affinity for thread: " <<  thr_id << std::endl;
-
-            struct sched_param sp;
-            sp.sched_priority = 10;
-            sched_setscheduler(0, SCHED_FIFO, &sp);
-#endif
+        std::vector<lane_stash> stashed;
+        stash.resize(ncells);
+        size_t offset = 0;
+        BOOST_FOREACH(lane *l, all)
+        {
+            std::copy(l->q, l->q + l->N, stash.begin() + offset);
+            stashed.push_back(lane_stash(l, offset, l->N));
+            offset += l->N;
+        }
 
-            worker &work = workers[thr_id];
-            for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        // lanes remesh picked new sizes for are cut anew; the assignment below sees their new N
+        if(resize)
+        {
+            min_h = std::numeric_limits<float>::max();
+            BOOST_FOREACH(lane *l, all)
             {
-                lane        *l             = work.macro_lanes[i];
-                if(!(l->is_macro() && l->active() && !l->fictitious))
-                    continue;
-                const float  max           = l->collect_riemann();
-                maxes[thr_id*MAXES_STRIDE] = std::max(max, maxes[thr_id*MAXES_STRIDE]);
+                if(l->h_next != l->h)
+                    l->macro_initialize(l->h_next);
+                min_h = std::min(min_h, l->h);
             }
+        }
 
-#pragma omp barrier
-#pragma omp single
+        // lanes joined by a link share a worker as far as the balance allows, so fewer ghosts cross threads
+        relayout_plan.assign(workers.size(), std::vector<lane_stash>());
+        if(graph_partition)
+        {
+            std::vector<lane*> ls;
+            BOOST_FOREACH(const lane_stash &st, stashed)
             {
-                maxspeed = 0.0f;
-                for(size_t t = 0; t < max_thr; ++t)
-                    maxspeed = std::max(maxspeed, maxes[t*MAXES_STRIDE]);
-
-                if(maxspeed < arz<float>::epsilon())
-                    maxspeed = min_h;
-
-                dt = std::min(cfl*min_h/maxspeed, 0.5f);
+                ls.push_back(st.l);
             }
 
-            for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+            std::vector<int> part;
+            partition_lanes(ls, true, workers.size(), part);
+            for(size_t i = 0; i < stashed.size(); ++i)
+                relayout_plan[part[i]].push_back(stashed[i]);
+        }
+        else
+        {
+            // longest-processing-time first: biggest active lane to the least loaded worker;
+            // idle lanes only need a home, so they go wherever storage is smallest
+            std::vector<lane_stash> order(stashed);
+            std::stable_sort(order.begin(), order.end(), lane_load_cmp());
+
+            std::vector<size_t> load (workers.size(), 0);
+            std::vector<size_t> cells(workers.size(), 0);
+            BOOST_FOREACH(const lane_stash &ls, order)
             {
-                lane *l = work.macro_lanes[i];
-                if(!(l->is_macro() && l->active() && !l->fictitious))
-                    continue;
-                l->update(dt, *this);
+                const size_t act = ls.l->active_cells();
+
+                size_t worker_no = 0;
+                for(size_t i = 1; i < workers.size(); ++i)
+                {
+                    if(act ? (load[i] < load[worker_no] || (load[i] == load[worker_no] && cells[i] < cells[worker_no]))
+                           : cells[i] < cells[worker_no])
+                        worker_no = i;
+                }
+
+                relayout_plan[worker_no].push_back(ls);
+                load [worker_no] += act;
+                cells[worker_no] += ls.l->N;
             }
         }
 
-        return dt;
+        relayout_pending = true;
+        flows_dirty      = true;
+        return true;
+    }
+
+    long simulator::partition_lanes(const std::vector<lane*> &ls, const bool by_activity, const int nparts,
+                                    std::vector<int> &part) const
+    {
+        // a vertex per lane, weighed by its cells (or by its active ones, plus one so idle lanes still
+        // spread out), and an edge for each link a lane reads ghosts across
+        std::vector<int> vertex(lanes.size(), -1);
+        partition_graph  g;
+        g.vwgt.resize(ls.size());
+        for(size_t i = 0; i < ls.size(); ++i)
+        {
+            vertex[lane_index(*ls[i])] = static_cast<int>(i);
+            g.vwgt[i]                  = by_activity ? ls[i]->active_cells() + 1 : ls[i]->N;
+        }
+
+        std::vector<std::pair<int, int> > edges;
+        for(size_t i = 0; i < ls.size(); ++i)
+        {
+            const lane_link &ln = link(*ls[i]);
+            if(ln.upstream_through >= 0)
+                edges.push_back(std::make_pair(static_cast<int>(i), vertex[ln.upstream_through]));
+            if(ln.downstream_through >= 0)
+                edges.push_back(std::make_pair(static_cast<int>(i), vertex[ln.downstream_through]));
+        }
+        g.build(edges);
+
+        return partition(g, nparts, partition_imbalance, part);
+    }
+
+    void simulator::relayout(const size_t thr_id)
+    {
+        assert(relayout_pending);
+
+        worker &w = workers[thr_id];
+        w.release();
+        w.macro_lanes.clear();
+        w.N = 0;
+        BOOST_FOREACH(const lane_stash &ls, relayout_plan[thr_id])
+        {
+            w.macro_lanes.push_back(ls.l);
+            w.N += ls.l->N;
+        }
+        w.allocate(huge_pages, numa_bind);
+        w.bind();
+
+        BOOST_FOREACH(const lane_stash &ls, relayout_plan[thr_id])
+        {
+            lane *l = ls.l;
+            if(l->N == ls.n)
+                std::copy(stash.begin() + ls.offset, stash.begin() + ls.offset + l->N, l->q);
+            else
+            {
+                remap_cells(l->q, l->N, &stash[ls.offset], ls.n);
+                l->find_wet();
+            }
+        }
+    }
+
+    bool simulator::remesh()
+    {
+        if(!sizing.adaptive() || step < remesh_step)
+            return false;
+        remesh_step = step + sizing.remesh_interval;
+
+        bool changed = false;
+        BOOST_FOREACH(const worker &w, workers)
+        {
+            BOOST_FOREACH(lane *l, w.macro_lanes)
+            {
+                l->h_next = l->h;
+                if(!(l->is_macro() && l->active() && !l->fictitious))
+                    continue;
+
+                const float h = sizing.remesh_h(*l);
+                if(static_cast<size_t>(std::ceil(l->length/h)) != l->N)
+                {
+                    l->h_next = h;
+                    changed   = true;
+                }
+            }
+        }
+
+        return changed;
+    }
+
+    void simulator::macro_cleanup()
+    {
+        free(maxes);
+        delete[] flows;
+        flows = 0;
+    }
+
+    void simulator::convert_cars(const sim_t sim_mask)
+    {
+        std::vector<lane*> &thelanes = sim_mask == MICRO ? micro_lanes : macro_lanes;
+        BOOST_FOREACH(lane *l, thelanes)
+        {
+            assert(l->sim_type & sim_mask);
+            if(!l->fictitious)
+                l->convert_cars(*this);
+        }
+    }
+
+    void simulator::convert_cars(const size_t thr_id, const sim_t sim_mask)
+    {
+        std::vector<lane*> &thelanes = sim_mask == MICRO ? micro_lanes : macro_lanes;
+        const size_t        nthr     = workers.size();
+        for(size_t i = thr_id; i < thelanes.size(); i += nthr)
+        {
+            lane *l = thelanes[i];
+            assert(l->sim_type & sim_mask);
+            if(!l->fictitious)
+                l->convert_cars(*this);
+        }
+    }
+
+    void simulator::macro_exchange(const size_t thr_id)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->pull_ghosts(*this);
+        }
+    }
+
+    float simulator::macro_collect(const size_t thr_id)
+    {
+        macro_exchange(thr_id);
+
+        worker &work               = workers[thr_id];
+        maxes[thr_id*MAXES_STRIDE] = 0.0f;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane        *l             = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->rate                    = l->collect_riemann(*this)*l->inv_h;
+            maxes[thr_id*MAXES_STRIDE] = std::max(l->rate, maxes[thr_id*MAXES_STRIDE]);
+        }
+
+        return maxes[thr_id*MAXES_STRIDE];
+    }
+
+    float simulator::macro_rate() const
+    {
+        float rate = 0.0f;
+        for(size_t t = 0; t < workers.size(); ++t)
+            rate = std::max(rate, maxes[t*MAXES_STRIDE]);
+        return rate;
+    }
+
+    float simulator::macro_dt(const float cfl, const float max_dt) const
+    {
+        return macro_dt(macro_rate(), cfl, max_dt);
+    }
+
+    float simulator::macro_dt(const float rate, const float cfl, const float max_dt) const
+    {
+        // the fastest lane may subcycle macro_max_level times; everyone else takes fewer, larger steps
+        if(rate < arz<float>::epsilon())
+            return max_dt;
+
+        return std::min(cfl*(1 << macro_max_level)/rate, max_dt);
+    }
+
+    int simulator::macro_level(const float rate, const float dt, const float cfl) const
+    {
+        int level = 0;
+        while(level < macro_max_level && dt*rate > cfl*(1 << level))
+            ++level;
+        return level;
+    }
+
+    int simulator::macro_substeps(const float dt, const float cfl) const
+    {
+        // maxes still holds what macro_collect found, so every thread agrees on the substep count
+        return 1 << macro_level(macro_rate(), dt, cfl);
+    }
+
+    void simulator::macro_begin_update(const size_t thr_id, const float dt, const float cfl)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->level   = macro_level(l->rate, dt, cfl);
+            l->inflow  = arz<float>::q(0.0f, 0.0f);
+            l->outflow = arz<float>::q(0.0f, 0.0f);
+        }
+    }
+
+    void simulator::macro_substep_collect(const size_t thr_id, const int s, const int substeps)
+    {
+        // macro_collect already did the first substep's fluctuations
+        assert(s > 0);
+
+        // a coarser neighbour already took its whole step at s == 0, so the ghost a finer lane reads
+        // from it is at the end of the step rather than at s; no interpolation, only reflux fixes the
+        // coarse side's flux up to the fine one's, so that the cars crossing stay counted once
+
+        macro_exchange(thr_id);
+
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious) || s % (substeps >> l->level))
+                continue;
+            l->collect_riemann(*this);
+        }
+    }
+
+    void simulator::macro_substep_update(const size_t thr_id, const float dt, const int s, const int substeps)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious) || s % (substeps >> l->level))
+                continue;
+            l->update(dt/(1 << l->level), *this, step, s);
+        }
+    }
+
+    void simulator::macro_reflux(const size_t thr_id)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->reflux(*this);
+        }
+    }
+
+    void simulator::macro_update(const size_t thr_id, const float dt, const float cfl)
+    {
+        macro_begin_update(thr_id, dt, cfl);
+
+        const int substeps = macro_substeps(dt, cfl);
+        for(int s = 0; s < substeps; ++s)
+        {
+            if(s > 0)
+            {
+                macro_substep_collect(thr_id, s, substeps);
+                pool->barrier(thr_id);
+            }
+
+            macro_substep_update(thr_id, dt, s, substeps);
+            pool->barrier(thr_id);
+        }
+
+        macro_reflux(thr_id);
+    }
+
+    void simulator::macro_lagged_rates(const int slot, float &rate, float &courant) const
+    {
+        rate    = 0.0f;
+        courant = 0.0f;
+        for(size_t t = 0; t < workers.size(); ++t)
+        {
+            rate    = std::max(rate,    maxes[t*MAXES_STRIDE + slot]);
+            courant = std::max(courant, maxes[t*MAXES_STRIDE + slot + 1]);
+        }
+    }
+
+    void simulator::macro_lagged_send(const size_t thr_id, const int parity)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->send_ends(parity);
+        }
+    }
+
+    void simulator::macro_lagged_begin(const size_t thr_id, const float dt, const float cfl, const int slot)
+    {
+        // levels come from the rates lanes found last attempt; from here on, rate is this attempt's fastest
+        macro_begin_update(thr_id, dt, cfl);
+
+        worker &work = workers[thr_id];
+        if(!work.q_saved)
+        {
+            work.q_saved = (arz<float>::q *) xmalloc_local(sizeof(arz<float>::q)*work.q_size(), huge_pages, numa_bind);
+            if(!work.q_saved)
+                throw std::exception();
+        }
+        memcpy(work.q_saved, work.q_base, sizeof(arz<float>::q)*work.q_size());
+
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->rate    = 0.0f;
+            l->emitted = 0;
+        }
+
+        maxes[thr_id*MAXES_STRIDE + slot]     = 0.0f;
+        maxes[thr_id*MAXES_STRIDE + slot + 1] = 0.0f;
+    }
+
+    void simulator::macro_lagged_substep(const size_t thr_id, const float dt, const int s, const int substeps,
+                                         const int parity, const int slot)
+    {
+        // ghosts come from what neighbours sent last substep, so each lane can solve and update
+        // in one go; the CFL number each update actually ran at is kept to check dt by
+        worker &work    = workers[thr_id];
+        float  &rate    = maxes[thr_id*MAXES_STRIDE + slot];
+        float  &courant = maxes[thr_id*MAXES_STRIDE + slot + 1];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            if(s % (substeps >> l->level) == 0)
+            {
+                const float sub_dt = dt/(1 << l->level);
+
+                l->pull_sent_ghosts(*this, parity);
+                const float lane_rate = l->collect_riemann(*this)*l->inv_h;
+                l->update(sub_dt, *this, step, s);
+
+                l->rate = std::max(l->rate, lane_rate);
+                rate    = std::max(rate,    lane_rate);
+                courant = std::max(courant, lane_rate*sub_dt);
+            }
+
+            l->send_ends(1 - parity);
+        }
+    }
+
+    void simulator::macro_lagged_restore(const size_t thr_id, const int parity)
+    {
+        worker &work = workers[thr_id];
+        memcpy(work.q_base, work.q_saved, sizeof(arz<float>::q)*work.q_size());
+
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            // take back the cars update sent on; they're the last ones in
+            if(l->emitted)
+            {
+                std::vector<car> &cars = lane_at(link(*l).downstream)->next_cars();
+                assert(cars.size() >= l->emitted);
+                cars.resize(cars.size() - l->emitted);
+                l->car_serial -= l->emitted;
+                l->emitted     = 0;
+            }
+
+            l->find_wet();
+            l->send_ends(parity);
+        }
+    }
+
+    // a lane's end bands in worker::fixed_bands: all of it if the two would meet, else width cells at each end
+    static size_t fixed_band_size(const lane &l, const size_t width)
+    {
+        return l.N <= 2*width ? l.N : 2*width;
+    }
+
+    static size_t fixed_end_index(const size_t lane_idx, const int end, const int t, const int block)
+    {
+        return (2*lane_idx + end)*(block + 1) + t;
+    }
+
+    arz<float>::q simulator::fixed_ghost(lane &l, const bool upstream, const int t)
+    {
+        // a neighbour that isn't stepped doesn't change; without one, the ghost is never read
+        lane *nbr = upstream ? l.upstream_macro(*this) : l.downstream_macro(*this);
+        if(!nbr)
+            return upstream ? *l.up_aux : *l.down_aux;
+        if(!nbr->active())
+            return upstream ? nbr->q[nbr->N-1] : nbr->q[0];
+        return fixed_ends[fixed_end_index(lane_index(*nbr), upstream ? 1 : 0, t, fixed_block)];
+    }
+
+    void simulator::macro_fixed_begin(const size_t thr_id)
+    {
+        worker       &work  = workers[thr_id];
+        const size_t  width = fixed_block;
+
+        size_t total = 0;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            const lane *l = work.macro_lanes[i];
+            if(l->is_macro() && l->active() && !l->fictitious)
+                total += fixed_band_size(*l, width);
+        }
+        work.fixed_bands.resize(total);
+
+        size_t offset = 0;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            arz<float>::q *band = &work.fixed_bands[offset];
+            if(l->N <= 2*width)
+                std::copy(l->q, l->q + l->N, band);
+            else
+            {
+                std::copy(l->q, l->q + width, band);
+                std::copy(l->q + l->N - width, l->q + l->N, band + width);
+            }
+            offset += fixed_band_size(*l, width);
+
+            const size_t idx = lane_index(*l);
+            fixed_ends[fixed_end_index(idx, 0, 0, fixed_block)] = l->q[0];
+            fixed_ends[fixed_end_index(idx, 1, 0, fixed_block)] = l->q[l->N-1];
+            l->level = 0;
+        }
+    }
+
+    void simulator::macro_fixed_ends(const size_t thr_id, const int t, const int steps, const float dt)
+    {
+        // step t of the bands; what each lane's ends will be over the pass, before any lane takes it
+        worker       &work  = workers[thr_id];
+        const size_t  width = fixed_block;
+        work.fixed_streams.resize(arz_streams::nstreams*2*width);
+        const arz_streams s(&work.fixed_streams[0], 2*width);
+
+        size_t offset = 0;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            arz<float>::q *band = &work.fixed_bands[offset];
+            offset += fixed_band_size(*l, width);
+
+            const bool whole = l->N <= 2*width;
+            // a long lane's last ends aren't read, and its bands are too narrow to have them right
+            if(!whole && t + 1 == steps)
+                continue;
+
+            const arz<float>::q up   = fixed_ghost(*l, true,  t);
+            const arz<float>::q down = fixed_ghost(*l, false, t);
+            if(whole)
+                l->fixed_step(*this, band, s, l->N, true, true, up, down, dt);
+            else
+            {
+                l->fixed_step(*this, band,         s, width, true,  false, up, down, dt);
+                l->fixed_step(*this, band + width, s, width, false, true,  up, down, dt);
+            }
+
+            const size_t idx = lane_index(*l);
+            fixed_ends[fixed_end_index(idx, 0, t + 1, fixed_block)] = band[0];
+            fixed_ends[fixed_end_index(idx, 1, t + 1, fixed_block)] = band[fixed_band_size(*l, width) - 1];
+        }
+    }
+
+    void simulator::macro_fixed_advance(const size_t thr_id, const int steps, const float dt)
+    {
+        worker       &work  = workers[thr_id];
+        const size_t  width = fixed_block;
+        const size_t  halo  = steps;
+        const size_t  tile  = std::max(fixed_tile, halo);
+
+        work.fixed_cells.resize(tile + 2*halo);
+        work.fixed_streams.resize(arz_streams::nstreams*(tile + 2*halo));
+        work.fixed_carry.resize(halo);
+        work.fixed_ghosts.resize(2*steps);
+        const arz_streams s(&work.fixed_streams[0], tile + 2*halo);
+
+        float &rate = maxes[thr_id*MAXES_STRIDE];
+        rate = 0.0f;
+
+        size_t offset = 0;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            const arz<float>::q *band = &work.fixed_bands[offset];
+            offset += fixed_band_size(*l, width);
+
+            // the bands already took the whole of a short lane through the pass
+            if(l->N <= 2*width)
+            {
+                std::copy(band, band + l->N, l->q);
+                l->find_wet();
+                continue;
+            }
+
+            for(int t = 0; t < steps; ++t)
+            {
+                work.fixed_ghosts[2*t]     = fixed_ghost(*l, true,  t);
+                work.fixed_ghosts[2*t + 1] = fixed_ghost(*l, false, t);
+            }
+
+            // each tile is taken through every step of the pass with a halo of one cell per step on
+            // each side, so what is left right at the end is the tile; the tile before has been
+            // written back by then, so its cells in this one's halo come from the carry
+            arz<float>::q *cells = &work.fixed_cells[0];
+            float          speed = 0.0f;
+            l->wet_begin = l->N;
+            l->wet_end   = 0;
+            for(size_t a = 0; a < l->N; a += tile)
+            {
+                const size_t b  = std::min(a + tile, l->N);
+                const size_t lo = a > halo ? a - halo : 0;
+                const size_t hi = std::min(b + halo, l->N);
+
+                std::copy(work.fixed_carry.begin(), work.fixed_carry.begin() + (a - lo), cells);
+                std::copy(l->q + a, l->q + hi, cells + (a - lo));
+                if(b < l->N)
+                    std::copy(l->q + b - halo, l->q + b, work.fixed_carry.begin());
+
+                for(int t = 0; t < steps; ++t)
+                    speed = std::max(l->fixed_step(*this, cells, s, hi - lo, lo == 0, hi == l->N,
+                                                   work.fixed_ghosts[2*t], work.fixed_ghosts[2*t + 1], dt),
+                                     speed);
+
+                std::copy(cells + (a - lo), cells + (b - lo), l->q + a);
+                for(size_t c = a; c < b; ++c)
+                {
+                    if(l->q[c].rho() > 0.0f)
+                    {
+                        l->wet_begin = std::min(l->wet_begin, c);
+                        l->wet_end   = c + 1;
+                    }
+                }
+            }
+
+            l->rate = speed*l->inv_h;
+            rate    = std::max(rate, l->rate);
+        }
+    }
+
+    struct macro_fixed_job : public thread_pool::job
+    {
+        macro_fixed_job(simulator &s, const int n, const float in_dt) : sim(s), nsteps(n), dt(in_dt)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &pool)
+        {
+            // a pass of up to fixed_block steps: the lanes' end bands go a step at a time in lockstep,
+            // so every lane knows its ghosts for the pass; then each lane goes through the whole pass
+            // a tile at a time, without waiting on anyone
+            for(int done = 0; done < nsteps; done += sim.fixed_block)
+            {
+                const int steps = std::min(sim.fixed_block, nsteps - done);
+
+                sim.macro_fixed_begin(thr_id);
+                pool.barrier(thr_id);
+
+                for(int t = 0; t < steps; ++t)
+                {
+                    sim.macro_fixed_ends(thr_id, t, steps, dt);
+                    pool.barrier(thr_id);
+                }
+
+                sim.macro_fixed_advance(thr_id, steps, dt);
+                pool.barrier(thr_id);
+            }
+        }
+
+        simulator   &sim;
+        const int    nsteps;
+        const float  dt;
+    };
+
+    void simulator::macro_fixed_run(const int nsteps, const float dt)
+    {
+        assert(pool->size() == workers.size());
+        assert(fixed_block > 0);
+
+        // a pass never emits cars, and fixed_ghost has no micro lane's ends to give
+        if(!micro_lanes.empty())
+            throw std::runtime_error("Fixed dt only steps an all-macro network!");
+
+        // there's no reduction to catch a wave outrunning dt partway through, so dt has to be under
+        // the bound macro_flow_prepare uses before any lane is stepped
+        float rate = 0.0f;
+        BOOST_FOREACH(const lane *l, macro_lanes)
+        {
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            const lane_link &ln = link(*l);
+            const float      u  = std::max(ln.speedlimit, std::max(ln.upstream_speedlimit, ln.downstream_speedlimit));
+            rate                = std::max(rate, std::max(1.0f, GAMMA)*u*l->inv_h);
+        }
+        if(rate*dt > 1.0f)
+            throw std::runtime_error("Fixed dt is past the CFL limit!");
+
+        rebalance();
+
+        fixed_ends.resize(2*lanes.size()*(fixed_block + 1));
+
+        macro_fixed_job job(*this, nsteps, dt);
+        pool->run(job);
+
+        step += nsteps;
+        time += nsteps*dt;
+    }
+
+    void lane_flow::seed(const lane &l)
+    {
+        ends[0].first = l.q[0];
+        ends[0].last  = l.q[l.N-1];
+        ends[0].from  = -1;
+        ends[0].until = 0;
+        count.store(0, std::memory_order_relaxed);
+    }
+
+    void lane_flow::publish(const lane &l, const int64_t from, const int64_t until)
+    {
+        // the other slot is the one no neighbour can still be reading
+        const unsigned  c    = count.load(std::memory_order_relaxed);
+        lane_ends      &next = ends[(c + 1) % 2];
+        next.first = l.q[0];
+        next.last  = l.q[l.N-1];
+        next.from  = from;
+        next.until = until;
+        count.store(c + 1, std::memory_order_release);
+    }
+
+    void simulator::build_flows()
+    {
+        if(!flows)
+            flows = new lane_flow[lanes.size()];
+
+        // a lane waits on the lanes it reads and on the lanes that read it, so that
+        // neither side can run ahead of the other
+        std::vector<std::vector<int> > nbrs(lanes.size());
+        BOOST_FOREACH(lane *l, macro_lanes)
+        {
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            const int  me   = static_cast<int>(lane_index(*l));
+            const lane *ends[2] = { l->upstream_macro(*this), l->downstream_macro(*this) };
+            for(int e = 0; e < 2; ++e)
+            {
+                if(!ends[e] || !ends[e]->active())
+                    continue;
+                const int other = static_cast<int>(lane_index(*ends[e]));
+                nbrs[me].push_back(other);
+                nbrs[other].push_back(me);
+            }
+        }
+
+        flow_nbrs.clear();
+        for(size_t i = 0; i < lanes.size(); ++i)
+        {
+            std::sort(nbrs[i].begin(), nbrs[i].end());
+            flows[i].nbr_begin = flow_nbrs.size();
+            flow_nbrs.insert(flow_nbrs.end(), nbrs[i].begin(), std::unique(nbrs[i].begin(), nbrs[i].end()));
+            flows[i].nbr_end   = flow_nbrs.size();
+        }
+    }
+
+    float simulator::macro_flow_prepare(const float cfl, const float max_dt)
+    {
+        if(!flows_dirty && cfl == flow_cfl && max_dt == flow_max_dt)
+            return flow_dt;
+
+        build_flows();
+
+        // no wave is faster than the fastest speed limit at either end of the lane (or, for the
+        // slow characteristic, than GAMMA times it); dt and every lane's level come from that bound
+        // rather than from a reduction over this step's Riemann solves
+        float rate = 0.0f;
+        BOOST_FOREACH(lane *l, macro_lanes)
+        {
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+
+            const lane_link &ln = link(*l);
+            const float      u  = std::max(ln.speedlimit, std::max(ln.upstream_speedlimit, ln.downstream_speedlimit));
+            l->rate_bound       = std::max(1.0f, GAMMA)*u*l->inv_h;
+            rate                = std::max(rate, l->rate_bound);
+        }
+
+        flow_dt = rate < arz<float>::epsilon() ? max_dt : std::min(cfl*(1 << macro_max_level)/rate, max_dt);
+        BOOST_FOREACH(lane *l, macro_lanes)
+        {
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            l->level = macro_level(l->rate_bound, flow_dt, cfl);
+        }
+
+        flow_cfl    = cfl;
+        flow_max_dt = max_dt;
+        flows_dirty = false;
+        return flow_dt;
+    }
+
+    void simulator::macro_flow_seed(const size_t thr_id)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            lane *l = work.macro_lanes[i];
+            if(!(l->is_macro() && l->active() && !l->fictitious))
+                continue;
+            flows[lane_index(*l)].seed(*l);
+            l->flow_next = 0;
+        }
+    }
+
+    bool simulator::macro_flow_act(lane &l, const float dt, size_t &overruns)
+    {
+        const int        substeps = 1 << macro_max_level;
+        const int64_t    period   = substeps + 1;
+        const int64_t    t        = l.flow_next;
+        const int64_t    k        = t/period;
+        const int        s        = static_cast<int>(t - k*period);
+        lane_flow       &mine     = flows[lane_index(l)];
+
+        for(size_t i = mine.nbr_begin; i < mine.nbr_end; ++i)
+        {
+            if(!flows[flow_nbrs[i]].ready(t))
+                return false;
+        }
+
+        if(s == substeps)
+        {
+            // every neighbour's flows for the step are in
+            l.reflux(*this);
+            l.flow_next = t + 1;
+        }
+        else
+        {
+            // neighbours only clear their flows once this lane's reflux is published
+            if(s == 0)
+            {
+                l.inflow  = arz<float>::q(0.0f, 0.0f);
+                l.outflow = arz<float>::q(0.0f, 0.0f);
+            }
+
+            l.pull_flow_ghosts(*this, t);
+            l.rate = l.collect_riemann(*this)*l.inv_h;
+
+            // rate_bound can't be outrun, so there's nothing to redo: fix() keeps rho in [0, 1) and
+            // y <= 0, so 0 <= u <= u_max and |u + rho u_eq'(rho)| <= max(1, GAMMA) u_max for every state,
+            // the Riemann waves between two states are no faster than their characteristics, and each
+            // end is solved with its neighbour's speed limit. A state that never went through fix()
+            // can still get past it, so that's counted, and macro_flow_run throws
+            if(l.rate > l.rate_bound*1.001f)
+                ++overruns;
+            const float sub_dt = dt/(1 << l.level);
+            l.update(sub_dt, *this, step + k, s);
+
+            l.flow_next = k*period + s + (substeps >> l.level);
+        }
+
+        mine.publish(l, t, l.flow_next);
+        return true;
+    }
+
+    void simulator::macro_flow(const size_t thr_id, const float dt, const int nsteps)
+    {
+        const int64_t end  = nsteps*static_cast<int64_t>((1 << macro_max_level) + 1);
+        worker       &work = workers[thr_id];
+
+        size_t left = 0;
+        for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+        {
+            const lane *l = work.macro_lanes[i];
+            if(l->is_macro() && l->active() && !l->fictitious && l->flow_next < end)
+                ++left;
+        }
+
+        // take each lane as far as its neighbours allow, and come back around for the ones that had to wait
+        int idle = 0;
+        while(left > 0)
+        {
+            bool progress = false;
+            for(size_t i = 0; i < work.macro_lanes.size(); ++i)
+            {
+                lane *l = work.macro_lanes[i];
+                if(!(l->is_macro() && l->active() && !l->fictitious) || l->flow_next >= end)
+                    continue;
+
+                while(l->flow_next < end && macro_flow_act(*l, dt, work.flow_overruns))
+                    progress = true;
+                if(l->flow_next >= end)
+                    --left;
+            }
+
+            if(progress)
+                idle = 0;
+            else if(++idle % 64 == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    size_t simulator::macro_flow_overruns()
+    {
+        size_t res = 0;
+        BOOST_FOREACH(worker &w, workers)
+        {
+            res             += w.flow_overruns;
+            w.flow_overruns  = 0;
+        }
+        return res;
+    }
+
+    struct macro_flow_job : public thread_pool::job
+    {
+        macro_flow_job(simulator &s, const float in_dt, const int n) : sim(s), dt(in_dt), nsteps(n)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &pool)
+        {
+            // the only barrier: nobody reads a lane's ends before they're seeded
+            sim.macro_flow_seed(thr_id);
+            pool.barrier(thr_id);
+
+            sim.macro_flow(thr_id, dt, nsteps);
+        }
+
+        simulator   &sim;
+        const float  dt;
+        const int    nsteps;
+    };
+
+    float simulator::macro_flow_run(const int nsteps, const float cfl, const float max_dt)
+    {
+        assert(pool->size() == workers.size());
+
+        rebalance();
+
+        const float dt = macro_flow_prepare(cfl, max_dt);
+        macro_flow_job job(*this, dt, nsteps);
+        pool->run(job);
+
+        step += nsteps;
+        time += nsteps*dt;
+
+        if(macro_flow_overruns() > 0)
+            throw std::runtime_error("Macro flow outran a lane's rate bound!");
+
+        return dt;
+    }
+
+    // dt for each step comes from the rates of the one before, so there is no reduction between
+    // solving and updating: a barrier per substep plus one after reflux. A step whose updates
+    // ran past cfl is undone and taken again with a dt from the rates it found
+    struct macro_lagged_job : public thread_pool::job
+    {
+        macro_lagged_job(simulator &s, const int n, const float c, const float m)
+            : sim(s), nsteps(n), cfl(c), max_dt(m), attempt(s.lagged_attempt), elapsed(0.0f), rollbacks(0)
+        {}
+
+        static int slot(const int a) { return 2*(a & 1); }
+
+        void operator()(const size_t thr_id, thread_pool &pool)
+        {
+            const float safe_cfl = cfl*sim.cfl_safety;
+
+            // nothing to lag behind yet; the first step's rates come from a collect, as in macro_step
+            int a = attempt;
+            if(a < 0)
+            {
+                sim.macro_collect(thr_id);
+                a = 0;
+            }
+
+            int parity = 0;
+            sim.macro_lagged_send(thr_id, parity);
+            pool.barrier(thr_id);
+
+            for(int k = 0; k < nsteps; ++k)
+            {
+                float rate, courant;
+                sim.macro_lagged_rates(slot(a), rate, courant);
+                for(;;)
+                {
+                    const float my_dt    = sim.macro_dt(rate, safe_cfl, max_dt);
+                    const int   substeps = 1 << sim.macro_level(rate, my_dt, safe_cfl);
+
+                    ++a;
+                    sim.macro_lagged_begin(thr_id, my_dt, safe_cfl, slot(a));
+
+                    for(int s = 0; s < substeps; ++s)
+                    {
+                        sim.macro_lagged_substep(thr_id, my_dt, s, substeps, parity, slot(a));
+                        parity = 1 - parity;
+                        pool.barrier(thr_id);
+                    }
+
+                    // every thread reads the same maxes here and comes to the same answer
+                    sim.macro_lagged_rates(slot(a), rate, courant);
+                    if(courant <= cfl)
+                    {
+                        sim.macro_reflux(thr_id);
+                        sim.macro_lagged_send(thr_id, parity);
+
+                        // nothing reads step between the last substep's barrier and this one
+                        if(thr_id == 0)
+                        {
+                            ++sim.step;
+                            sim.time += my_dt;
+                            elapsed  += my_dt;
+                        }
+                        pool.barrier(thr_id);
+                        break;
+                    }
+
+                    sim.macro_lagged_restore(thr_id, parity);
+                    pool.barrier(thr_id);
+
+                    if(thr_id == 0)
+                        ++rollbacks;
+                }
+            }
+
+            if(thr_id == 0)
+                attempt = a;
+        }
+
+        simulator   &sim;
+        const int    nsteps;
+        const float  cfl;
+        const float  max_dt;
+        int          attempt;
+        float        elapsed;
+        size_t       rollbacks;
+    };
+
+    // saves barriers only across many steps in one job; a single step has more than macro_step does.
+    // Advances step and time by each step taken, and returns the time they covered
+    float simulator::macro_lagged_run(const int nsteps, const float cfl, const float max_dt)
+    {
+        assert(pool->size() == workers.size());
+
+        rebalance();
+
+        macro_lagged_job job(*this, nsteps, cfl, max_dt);
+        pool->run(job);
+
+        lagged_attempt  = job.attempt;
+        cfl_rollbacks  += job.rollbacks;
+        return job.elapsed;
+    }
+
+    struct macro_step_job : public thread_pool::job
+    {
+        macro_step_job(simulator &s, const float c) : sim(s), cfl(c), dt(0.0f)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &pool)
+        {
+            sim.macro_collect(thr_id);
+
+            pool.barrier(thr_id);
+
+            // every thread reduces maxes itself; cheaper than another barrier
+            const float my_dt = sim.macro_dt(cfl, 0.5f);
+            if(thr_id == 0)
+                dt = my_dt;
+
+            sim.macro_update(thr_id, my_dt, cfl);
+        }
+
+        simulator   &sim;
+        const float  cfl;
+        float        dt;
+    };
+
+    float simulator::macro_step(const float cfl)
+    {
+        assert(pool->size() == workers.size());
+
+        rebalance();
+
+        macro_step_job job(*this, cfl);
+        pool->run(job);
+
+        return job.dt;
     }
 
     float simulator::macro_length() const
@@ -29,6 +29,20 @@ namespace hybrid
         float y_;
     };
 
+    // orders cars by position against a bare parameter, for searches in the sorted current_cars()
+    struct car_position_cmp
+    {
+        inline bool operator()(const float p, const car &c) const
+        {
+            return p < c.position;
+        }
+
+        inline bool operator()(const car &c, const float p) const
+        {
+            return c.position < p;
+        }
+    };
+
     mat4x4f car::point_frame(const hwm::lane* l, const float lane_width) const
     {
         mat4x4f trans;
@@ -94,23 +108,17 @@ namespace hybrid
         bool  found_a_follower = false;
 
         //Find the cars ahead and behind of where the car will merge
-        ///TODO should do a binary search for positon
-        for (int i = 0; i < (int)l->current_cars().size(); i++)
+        const std::vector<car>           &cars  = l->current_cars();
+        std::vector<car>::const_iterator  ahead = std::upper_bound(cars.begin(), cars.end(), param, car_position_cmp());
+        if (ahead != cars.end())
         {
-            potential_leader   = l->current_car(i);
-
-            if (potential_leader.position > param)
-            {
-                found_a_leader = true;
-                break;
-            }
-
-            potential_follower = l->current_car(i);
-
-            if (potential_follower.position <= param)
-            {
-                found_a_follower = true;
-            }
+            potential_leader = *ahead;
+            found_a_leader   = true;
+        }
+        if (ahead != cars.begin())
+        {
+            potential_follower = *(ahead - 1);
+            found_a_follower   = true;
         }
 
         if (found_a_leader == false)
@@ -127,7 +135,7 @@ namespace hybrid
         car  potential_next_follower(0, 0, 0, 0);
         car  potential_next_leader(0, 0, 0, 0);
 
-        //Check for next cars too
+        //Check for next cars too; only the few emitted since the last swap, unsorted
         for (int i = 0; i < (int)l->next_cars().size(); i++)
         {
             potential_next_leader   = l->next_car(i);
@@ -251,18 +259,22 @@ namespace hybrid
     {
         const float  min_for_free_movement = 1000;
 
-        if(l.parent->end->network_boundary())
+        const lane_link &ln = sim.link(l);
+        if(ln.end_boundary)
         {
-            next_velocity = l.speedlimit();
+            next_velocity = ln.speedlimit;
             distance      = min_for_free_movement;
             return;
         }
 
-        hwm::lane *hwm_downstream = l.parent->downstream_lane();
-        next_velocity             = 0.0f;
-        distance                  = (1.0 - position) * l.length - sim.rear_bumper_offset();
-        if(hwm_downstream)
-            hwm_downstream->user_data<lane>()->distance_to_car(distance, next_velocity, min_for_free_movement, sim);
+        const lane *downstream = sim.lane_at(ln.downstream);
+        next_velocity          = 0.0f;
+        distance               = (1.0 - position) * l.length - sim.rear_bumper_offset();
+        if(downstream)
+        {
+            if(!sim.lookahead_ready || !downstream->ahead.query(distance, next_velocity, min_for_free_movement))
+                downstream->distance_to_car(distance, next_velocity, min_for_free_movement, sim);
+        }
     }
 
     void car::compute_intersection_acceleration(const simulator &sim, const lane &l)
@@ -280,6 +292,11 @@ namespace hybrid
         velocity  = std::max(0.0f, velocity + acceleration * timestep);
         position += (velocity * timestep) * l.inv_length;
 
+        integrate_merge(timestep, lane_width);
+    }
+
+    void car::integrate_merge(const float timestep, const float lane_width)
+    {
         //Move car that is also a member of the other lane
         if (other_lane_membership.other_lane != 0)
         {
@@ -313,20 +330,26 @@ namespace hybrid
 
     car lane::get_merging_leader(float param, const lane* other_lane)
     {
+        // the furthest car merging in from other_lane, if it is past param
         car cur_car(-1, -1, -1, -1);
-        for (size_t i = 0; i < current_cars().size(); i++)
+        for (std::vector<size_t>::const_reverse_iterator m = merging_in.rbegin(); m != merging_in.rend(); ++m)
         {
-            if (current_car(i).other_lane_membership.other_lane != 0)
+            if (*m >= current_cars().size())
+                continue;
+
+            const car &c = current_car(*m);
+            if (c.other_lane_membership.other_lane != other_lane)
+                continue;
+
+            if (c.position >= param)
             {
-                if (current_car(i).other_lane_membership.other_lane == other_lane)
-                {
-                    if (current_car(i).position >= param)
-                    {
-                        cur_car = current_car(i);
-                        cur_car.position = current_car(i).other_lane_membership.position;
-                    }
-                }
+                // only position and velocity; acceleration may be in flux on another thread
+                cur_car = car(c.id,
+                              c.other_lane_membership.position,
+                              c.velocity,
+                              0.0f);
             }
+            break;
         }
 
         bool nxt_car_found = false;
@@ -365,16 +388,17 @@ namespace hybrid
             }
             else
             {
-                if(parent->end->network_boundary())
+                const lane_link &ln = sim.link(*this);
+                if(ln.end_boundary)
                 {
                     velocity = 0.0f;
                     distance = distance_max;
                     return;
                 }
 
-                hwm::lane *hwm_downstream = parent->downstream_lane();
-                if(hwm_downstream)
-                    hwm_downstream->user_data<lane>()->distance_to_car(distance, velocity, distance_max, sim);
+                const lane *downstream = sim.lane_at(ln.downstream);
+                if(downstream)
+                    downstream->distance_to_car(distance, velocity, distance_max, sim);
                 else
                     velocity = 0.0f;
             }
@@ -388,7 +412,7 @@ namespace hybrid
         return;
     }
 
-    void lane::compute_merges(const float timestep, const simulator& sim)
+    void lane::compute_merges(const float timestep, const simulator& sim, worker &out)
     {
         assert(is_micro());
         float threshold = 0.2;
@@ -421,105 +445,143 @@ namespace hybrid
                         left_accel = current_car(i).check_lane(left_lane, left_param, timestep, sim);
                 }
 
-                //Merge the cars
+                //Merge the cars; current_cars() stays untouched as other lanes are reading it
                 if (right_accel  > threshold
                     || left_accel > threshold)
                 {
+                    car merging(current_car(i));
+                    merging.other_lane_membership.other_lane  = this;
+                    merging.other_lane_membership.merge_param = 0;
+                    merging.other_lane_membership.position    = merging.position;
                     if (right_accel > left_accel)
                     {
-                        current_car(i).other_lane_membership.other_lane  = this;
-                        current_car(i).other_lane_membership.merge_param = 0;
-                        current_car(i).other_lane_membership.position    = current_car(i).position;
-                        current_car(i).other_lane_membership.is_left     = false;
-                        current_car(i).position                          = right_param;
-
-                        right_lane->next_cars().push_back(current_car(i));
+                        merging.other_lane_membership.is_left = false;
+                        merging.position                      = right_param;
+                        out.send(right_lane, merging);
                     }
                     else
                     {
-                        current_car(i).other_lane_membership.other_lane  = this;
-                        current_car(i).other_lane_membership.merge_param = 0;
-                        current_car(i).other_lane_membership.position    = current_car(i).position;
-                        current_car(i).other_lane_membership.is_left     = true;
-                        current_car(i).position                          = left_param;
-                        left_lane->next_cars().push_back(current_car(i));
+                        merging.other_lane_membership.is_left = true;
+                        merging.position                      = left_param;
+                        out.send(left_lane, merging);
                     }
                 }
                 else
                 {
-                    next_cars().push_back(current_car(i));
+                    out.send(this, current_car(i));
                 }
             }
             else
             {
-                next_cars().push_back(current_car(i));
+                out.send(this, current_car(i));
             }
         }
     }
 
     car& lane::find_next_car(float param)
     {
-        //TODO bisect search
-        for (size_t i = 0; i < current_cars().size(); i++)
+        std::vector<car>::iterator c = std::lower_bound(current_cars().begin(), current_cars().end(), param, car_position_cmp());
+        if (c != current_cars().end())
+            return *c;
+
+        assert(0);
+        return current_cars()[0];
+    }
+
+    void lane::compute_car_acceleration(const size_t i, const car *leader, const simulator &sim)
+    {
+        if (leader)
+            current_car(i).compute_acceleration(*leader, (leader->position - current_car(i).position)*length, sim);
+        else
+            current_car(i).compute_intersection_acceleration(sim, *this);
+
+        apply_merge_limits(i, sim);
+    }
+
+    void lane::apply_merge_limits(const size_t i, const simulator &sim)
+    {
+        // //Check if there are cars still merging out of this lane.
+        float right_param = current_car(i).position;
+        hwm::lane* potential_right = parent->right_adjacency(right_param);
+        lane* right_lane;
+        float right_accel = 0;
+        car next_r;
+        if (potential_right)
         {
-            if (current_car(i).position >= param)
+            right_lane = potential_right->user_data<lane>();
+
+            next_r  = right_lane->get_merging_leader(right_param, this);
+
+            if (next_r.position > -1)
+                right_accel = sim.acceleration(next_r.velocity, current_car(i).velocity, std::abs(next_r.position - right_param)*right_lane->length);
+        }
+
+        float left_param = current_car(i).position;
+        hwm::lane* potential_left = parent->left_adjacency(left_param);
+        lane* left_lane;
+        float left_accel = 0;
+        car next_l;
+        if (potential_left)
+        {
+            left_lane = potential_left->user_data<lane>();
+
+            next_l  = left_lane->get_merging_leader(left_param, this);
+            if (next_l.position > -1)
             {
-                return current_car(i);
+                left_accel = sim.acceleration(next_l.velocity, current_car(i).velocity, std::abs(next_l.position - left_param)*left_lane->length);
             }
         }
-        assert(0);
-        return current_cars()[0];
+
+        if (potential_right && next_r.position > -1)
+            current_car(i).acceleration = std::min(current_car(i).acceleration, (float)right_accel);
+
+        if (potential_left && next_l.position > -1)
+            current_car(i).acceleration = std::min(current_car(i).acceleration, (float)left_accel);
     }
 
     void lane::compute_lane_accelerations(const float timestep, const simulator &sim)
     {
-        if(current_cars().empty())
+        const size_t n = current_cars().size();
+        if(n == 0)
             return;
 
-        for(size_t i = 0; i < current_cars().size(); ++i)
+        // followers in one batch, then the front car and the merge limits
+        const size_t pairs = n - 1;
+        micro_scratch.resize(4*pairs + 1);
+        float *leader_velocity   = &micro_scratch[0];
+        float *follower_velocity = leader_velocity   + pairs;
+        float *distance          = follower_velocity + pairs;
+        float *out               = distance          + pairs;
+        for(size_t i = 0; i < pairs; ++i)
         {
-            if (i < current_cars().size() - 1)
-                current_car(i).compute_acceleration(current_car(i+1), (current_car(i+1).position - current_car(i).position)*length, sim);
-            else
-                current_cars().back().compute_intersection_acceleration(sim, *this);
-
-            // //Check if there are cars still merging out of this lane.
-            float right_param = current_car(i).position;
-            hwm::lane* potential_right = parent->right_adjacency(right_param);
-            lane* right_lane;
-            float right_accel = 0;
-            car next_r;
-            if (potential_right)
-            {
-                right_lane = potential_right->user_data<lane>();
-
-                next_r  = right_lane->get_merging_leader(right_param, this);
+            leader_velocity[i]   = current_car(i+1).velocity;
+            follower_velocity[i] = current_car(i).velocity;
+            distance[i]          = (current_car(i+1).position - current_car(i).position)*length;
+        }
 
-                if (next_r.position > -1)
-                    right_accel = sim.acceleration(next_r.velocity, current_car(i).velocity, std::abs(next_r.position - right_param)*right_lane->length);
-            }
+        accelerations(sim.model, leader_velocity, follower_velocity, distance, out, pairs);
 
-            float left_param = current_car(i).position;
-            hwm::lane* potential_left = parent->left_adjacency(left_param);
-            lane* left_lane;
-            float left_accel = 0;
-            car next_l;
-            if (potential_left)
-            {
-                left_lane = potential_left->user_data<lane>();
+        for(size_t i = 0; i < pairs; ++i)
+            current_car(i).acceleration = out[i];
+        current_cars().back().compute_intersection_acceleration(sim, *this);
 
-                next_l  = left_lane->get_merging_leader(left_param, this);
-                if (next_l.position > -1)
-                {
-                    left_accel = sim.acceleration(next_l.velocity, current_car(i).velocity, std::abs(next_l.position - left_param)*left_lane->length);
-                }
-            }
+        for(size_t i = 0; i < n; ++i)
+            apply_merge_limits(i, sim);
+    }
 
-            if (potential_right && next_r.position > -1)
-                current_car(i).acceleration = std::min(current_car(i).acceleration, (float)right_accel);
+    void lane::integrate_cars(const float timestep, const float lane_width)
+    {
+        // in place; streaming the cars out to SoA and back costs more than the kernel saves,
+        // and only the few cars in merging_in need the merge update
+        BOOST_FOREACH(car &c, current_cars())
+        {
+            c.velocity  = std::max(0.0f, c.velocity + c.acceleration * timestep);
+            c.position += (c.velocity * timestep) * inv_length;
+        }
 
-            if (potential_left && next_l.position > -1)
-                current_car(i).acceleration = std::min(current_car(i).acceleration, (float)left_accel);
+        BOOST_FOREACH(const size_t m, merging_in)
+        {
+            current_car(m).integrate_merge(timestep, lane_width);
         }
     }
 
@@ -528,18 +590,21 @@ namespace hybrid
         assert(is_micro());
         current_cars().clear();
         next_cars().clear();
+        merging_in.clear();
+
+        simulator::rand_gen_t r(sim.rng(*this, RNG_POPULATE));
 
-        float t = pproc::exp_rvar((*sim.uni)())/rate*inv_length;
+        float t = pproc::exp_rvar(r())/rate*inv_length;
         if(t > 1.0)
             return;
         do
         {
-            current_cars().push_back(sim.make_car(t, 0, 0));
+            current_cars().push_back(sim.make_car(*this, t, 0, 0));
 
             float next;
             do
             {
-                next = pproc::exp_rvar((*sim.uni)())/rate;
+                next = pproc::exp_rvar(r())/rate;
             }
             while(next < 2*sim.car_length);
             t += next*inv_length;
@@ -550,16 +615,37 @@ namespace hybrid
     float lane::settle_pass(const float timestep, const float epsilon, const float epsilon_2,
                             const simulator &sim)
     {
+        // Cars are settled front to back. A car's acceleration only depends
+        // on its own velocity and on the (already settled) car ahead, so
+        // only that one acceleration is recomputed per iteration. Removed
+        // cars are flagged and compacted out at the end; 'ahead' holds the
+        // surviving cars in front of the current one, nearest on top.
+        // Lanes are settled concurrently, so no car may be mid-merge.
+        assert(merging_in.empty());
+
+        const int          n = static_cast<int>(current_cars().size());
+        std::vector<char>  removed(n, 0);
+        std::vector<int>   ahead;
+        ahead.reserve(n);
+
         float max_acceleration = epsilon;
-        int i = static_cast<int>(current_cars().size())-1;
-        while(!current_cars().empty() && i >= 0)
+        int   next             = n-1;
+        int   i                = -1;
+        while(true)
         {
+            if(i < 0)
+            {
+                if(next < 0)
+                    break;
+                i = next--;
+            }
+
             car &c = current_car(i);
 
             float last_acceleration = std::numeric_limits<float>::max();
             while(true)
             {
-                compute_lane_accelerations(timestep, sim);
+                compute_car_acceleration(i, ahead.empty() ? 0 : &current_car(ahead.back()), sim);
 
                 c.velocity = std::max(c.velocity + c.acceleration * timestep,
                                       0.0f);
@@ -570,20 +656,41 @@ namespace hybrid
                     || c.position+sim.front_bumper_offset()*inv_length >= 1.0
                     || ((std::abs(c.acceleration - last_acceleration) < epsilon_2) && (std::abs(c.acceleration) > epsilon)))
                 {
-                    for(int j = i; j < static_cast<int>(current_cars().size())-1; ++j)
-                        current_car(j) = current_car(j+1);
-                    current_cars().pop_back();
+                    // drop the car; the one ahead of it has a new follower gap to check
+                    removed[i] = 1;
+                    if(ahead.empty())
+                        i = -1;
+                    else
+                    {
+                        i = ahead.back();
+                        ahead.pop_back();
+                    }
                     break;
                 }
                 else if(std::abs(c.acceleration) < epsilon)
                 {
-                    --i;
+                    ahead.push_back(i);
+                    i = -1;
                     break;
                 }
 
                 last_acceleration = c.acceleration;
             }
         }
+
+        size_t kept = 0;
+        for(int j = 0; j < n; ++j)
+        {
+            if(removed[j])
+                continue;
+            if(kept != static_cast<size_t>(j))
+                std::swap(current_car(kept), current_car(j));
+            ++kept;
+        }
+        current_cars().resize(kept);
+
+        compute_lane_accelerations(timestep, sim);
+
         return max_acceleration;
     }
 
@@ -625,151 +732,353 @@ namespace hybrid
         a_pref                = in_a_pref;
         v_pref                = in_v_pref;
         delta                 = in_delta;
+
+        car_following_params p;
+        p.a_max      = a_max;
+        p.a_pref     = a_pref;
+        p.v_pref     = v_pref;
+        p.delta      = delta;
+        p.car_length = car_length;
+        model        = car_following_t(p);
     }
 
+    struct settle_job : public thread_pool::job
+    {
+        settle_job(simulator &s, const float ts, const float e, const float e2)
+            : sim(s), timestep(ts), epsilon(e), epsilon_2(e2), maxes(s.pool->size(), e)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &pool)
+        {
+            float max_acceleration = epsilon;
+            for(size_t i = thr_id; i < sim.micro_lanes.size(); i += pool.size())
+            {
+                lane *l = sim.micro_lanes[i];
+                assert(l->is_micro());
+                assert(l->active());
+                max_acceleration = std::max(l->settle_pass(timestep, epsilon, epsilon_2, sim),
+                                            max_acceleration);
+            }
+            maxes[thr_id] = max_acceleration;
+        }
+
+        simulator          &sim;
+        const float         timestep;
+        const float         epsilon;
+        const float         epsilon_2;
+        std::vector<float>  maxes;
+    };
+
     void simulator::settle(const float timestep)
     {
         static const float EPSILON   = 1;
         static const float EPSILON_2 = 0.01;
 
+        // lanes settle in parallel; each pass sees the other lanes through the lookahead built before it
         float max_acceleration;
         do
         {
-            max_acceleration = EPSILON;
-            BOOST_FOREACH(lane *l, micro_lanes)
-            {
-                assert(l->is_micro());
-                assert(l->active());
-                max_acceleration = std::max(l->settle_pass(timestep, EPSILON, EPSILON_2, *this),
-                                            (float) max_acceleration);
-            }
+            build_lookahead();
+
+            settle_job job(*this, timestep, EPSILON, EPSILON_2);
+            pool->run(job);
+            max_acceleration = *std::max_element(job.maxes.begin(), job.maxes.end());
 
             std::cout << "Max acceleration in settle: " << max_acceleration << std::endl;
         }
         while(max_acceleration > EPSILON);
+
+        lookahead_ready = false;
+    }
+
+    void simulator::micro_partition()
+    {
+        const size_t nthr  = workers.size();
+        size_t       total = 0;
+        BOOST_FOREACH(const lane *l, micro_lanes)
+        {
+            total += l->ncars() + 1;
+        }
+
+        // contiguous blocks of micro_lanes with about the same number of cars each
+        micro_blocks.assign(nthr + 1, micro_lanes.size());
+        micro_blocks[0] = 0;
+
+        size_t thr_id = 0;
+        size_t so_far = 0;
+        for(size_t i = 0; i < micro_lanes.size(); ++i)
+        {
+            while(thr_id + 1 < nthr && so_far*nthr >= (thr_id + 1)*total)
+                micro_blocks[++thr_id] = i;
+
+            micro_lanes[i]->micro_owner  = thr_id;
+            so_far                      += micro_lanes[i]->ncars() + 1;
+        }
+
+        BOOST_FOREACH(worker &w, workers)
+        {
+            w.outbox.resize(nthr);
+            assert(w.injections.empty());
+        }
     }
 
-    float simulator::acceleration(const float leader_velocity, const float follower_velocity, float distance) const
+    void simulator::build_lookahead()
     {
-        static const float s1 = 2;
-        static const float T  = 1.6;
-        const float EPSILON = 10e-7;
+        // only the lanes the last build marked need clearing; the rest of the network is never touched
+        BOOST_FOREACH(lane *l, lookahead_lanes)
+        {
+            l->ahead.mark = 0;
+        }
+        lookahead_lanes.clear();
+
+        // walk each chain of empty lanes once, then fill it in back to front; only the lanes
+        // micro lanes feed are ever asked, and starting there keeps off of lanes no car can see
+        std::vector<lane*> path;
+        BOOST_FOREACH(const lane *m, micro_lanes)
+        {
+            const lane_link &ml = link(*m);
+            if(ml.end_boundary || ml.downstream < 0)
+                continue;
+
+            path.clear();
+            lookahead tail;
+            lane     *l = lane_at(ml.downstream);
+            while(1)
+            {
+                if(l->ahead.mark == 2)
+                {
+                    tail = l->ahead;
+                    break;
+                }
+                if(l->ahead.mark == 1)
+                {
+                    tail.capped = true;
+                    break;
+                }
+
+                l->ahead.mark = 1;
+                lookahead_lanes.push_back(l);
+                if(l->leading_vehicle(l->ahead.distance, l->ahead.velocity, *this))
+                {
+                    l->ahead.reach  = 0.0f;
+                    l->ahead.walked = false;
+                    l->ahead.capped = false;
+                    l->ahead.mark   = 2;
+                    tail            = l->ahead;
+                    break;
+                }
+
+                path.push_back(l);
+                const lane_link &ln = link(*l);
+                if(ln.end_boundary)
+                {
+                    tail.capped = true;
+                    break;
+                }
+
+                lane *downstream = lane_at(ln.downstream);
+                if(!downstream)
+                    break;
+                l = downstream;
+            }
+
+            for(std::vector<lane*>::reverse_iterator p = path.rbegin(); p != path.rend(); ++p)
+            {
+                lookahead &a = (*p)->ahead;
+                a.distance   = (*p)->length + tail.distance;
+                a.velocity   = tail.velocity;
+                a.reach      = (*p)->length + tail.reach;
+                a.walked     = true;
+                a.capped     = tail.capped;
+                a.mark       = 2;
+                tail         = a;
+            }
+        }
+
+        lookahead_ready = true;
+    }
+
+    void simulator::micro_deliver(const size_t thr_id)
+    {
+        // walking sources in thread order keeps each lane's arrivals in micro_lanes order
+        BOOST_FOREACH(worker &w, workers)
+        {
+            std::vector<car_transfer> &box = w.outbox[thr_id];
+            BOOST_FOREACH(const car_transfer &t, box)
+            {
+                assert(t.dest->micro_owner == thr_id);
+                t.dest->next_cars().push_back(t.c);
+            }
+            box.clear();
+        }
+    }
+
+    void simulator::transfer_cars(lane &l, worker &out)
+    {
+        BOOST_FOREACH(car &c, l.current_cars())
+        {
+            lane* destination_lane = &l;
+            lane* curr             = &l;
 
-        //if (f.vel < 0) f.vel = 0; //TODO Should this be taken into account?
+            while(c.position >= 1.0)
+            {
+                const lane_link &ln = link(*curr);
+                if(ln.end_boundary)
+                    goto next_car;
+
+                lane *downstream = lane_at(ln.downstream);
+                assert(downstream);
+                assert(downstream->active());
+
+                switch(downstream->sim_type)
+                {
+                case MICRO:
+                    c.position = (c.position - 1.0f) * curr->length * downstream->inv_length;
+                    destination_lane = downstream;
+                    break;
+                case MACRO: //TODO update for correctness
+                    downstream = lane_at(ln.downstream_through);
+                    assert(downstream);
+                    assert(!downstream->fictitious);
+                    out.injections.push_back(macro_injection(downstream, c.velocity));
+                    goto next_car;
+                }
 
-        const float optimal_spacing = s1 + T*follower_velocity + (follower_velocity*(follower_velocity - leader_velocity))/2*(std::sqrt(a_max*a_pref));
+                if (c.position >= 1.0)
+                    curr = downstream;
+            }
 
-        if (distance > car_length)
-            distance -= car_length;
-        if (distance <= 0)
-            distance = EPSILON;
+            assert(c.position < 1.0);
 
-        //         std::cout << "leader vel " << leader_velocity << " dist " << distance << std::endl;
-        const float t               = a_max*(1 - std::pow((follower_velocity / v_pref), delta) - std::pow((optimal_spacing/(distance)), 2));
+            assert(destination_lane->is_micro());
+            out.send(destination_lane, c);
 
-        //assert(l.dist - f.dist > 0); //A leader needs to lead.
-        return t;
+        next_car:;
+        }
     }
 
-    void simulator::compute_accelerations(const float timestep)
+    void simulator::apply_injections()
     {
-        BOOST_FOREACH(lane *l, micro_lanes)
+        BOOST_FOREACH(worker &w, workers)
         {
+            BOOST_FOREACH(const macro_injection &inj, w.injections)
+            {
+                lane *downstream = inj.dest;
+                downstream->q[0].rho() = std::min(1.0f, downstream->q[0].rho() + car_length/downstream->h);
+                downstream->q[0].y()   = std::min(0.0f, arz<float>::eq::y(downstream->q[0].rho(), inj.velocity,
+                                                                          downstream->speedlimit()));
+                assert(downstream->q[0].check());
+                downstream->mark_wet(0);
+            }
+            w.injections.clear();
+        }
+    }
+
+    void simulator::micro_accelerations(const size_t thr_id, const float timestep)
+    {
+        for(size_t i = micro_blocks[thr_id]; i < micro_blocks[thr_id+1]; ++i)
+        {
+            lane *l = micro_lanes[i];
             assert(l->is_micro());
             if(!l->active())
                 continue;
             l->compute_lane_accelerations(timestep, *this);
         }
+    }
 
-        BOOST_FOREACH(lane *l, micro_lanes)
+    void simulator::micro_merges(const size_t thr_id, const float timestep)
+    {
+        worker &work = workers[thr_id];
+        for(size_t i = micro_blocks[thr_id]; i < micro_blocks[thr_id+1]; ++i)
         {
-            assert(l->is_micro());
+            lane *l = micro_lanes[i];
             if(!l->active())
                 continue;
-            l->compute_merges(timestep, *this);
+            l->compute_merges(timestep, *this, work);
         }
+    }
 
-        BOOST_FOREACH(lane *l, micro_lanes)
+    void simulator::micro_swap(const size_t thr_id)
+    {
+        for(size_t i = micro_blocks[thr_id]; i < micro_blocks[thr_id+1]; ++i)
         {
-            assert(l->is_micro());
+            lane *l = micro_lanes[i];
             if(!l->active())
                 continue;
             l->car_swap();
         }
     }
 
-    void simulator::update(const float timestep)
+    void simulator::micro_integrate(const size_t thr_id, const float timestep)
     {
-        compute_accelerations(timestep);
-
-        apply_roadblocks();
-
-        BOOST_FOREACH(lane *l, micro_lanes)
+        worker &work = workers[thr_id];
+        for(size_t i = micro_blocks[thr_id]; i < micro_blocks[thr_id+1]; ++i)
         {
-            assert(l->is_micro());
+            lane *l = micro_lanes[i];
             if(!l->active())
                 continue;
 
-            BOOST_FOREACH(car &c, l->current_cars())
-            {
-                c.integrate(timestep, *l, hnet->lane_width);
-            }
+            l->integrate_cars(timestep, hnet->lane_width);
+
+            transfer_cars(*l, work);
         }
+    }
 
-        BOOST_FOREACH(lane *l, micro_lanes)
+    void simulator::micro_update(const size_t thr_id, const float timestep)
+    {
+        if(thr_id == 0)
         {
-            assert(l->is_micro());
-            if(!l->active())
-                continue;
+            micro_partition();
+            build_lookahead();
+        }
+        pool->barrier(thr_id);
 
-            BOOST_FOREACH(car &c, l->current_cars())
-            {
-                lane* destination_lane = l;
-                lane* curr             = l;
+        micro_accelerations(thr_id, timestep);
+        pool->barrier(thr_id);
 
-                while(c.position >= 1.0)
-                {
-                    if(curr->parent->end->network_boundary())
-                        goto next_car;
+        micro_merges(thr_id, timestep);
+        pool->barrier(thr_id);
 
-                    lane *downstream = curr->downstream_lane();
-                    assert(downstream);
-                    assert(downstream->active());
+        micro_deliver(thr_id);
+        pool->barrier(thr_id);
 
-                    switch(downstream->sim_type)
-                    {
-                    case MICRO:
-                        c.position = (c.position - 1.0f) * curr->length * downstream->inv_length;
-                        // downstream->next_cars().push_back(c);
-                        destination_lane = downstream;
-                        break;
-                    case MACRO: //TODO update for correctness
-                        if(downstream->fictitious)
-                        {
-                            lane *next_downstream = downstream->downstream_lane();
-                            assert(next_downstream);
-                            assert(!next_downstream->fictitious);
-                            downstream = next_downstream;
-                        }
-                        downstream->q[0].rho() = std::min(1.0f, downstream->q[0].rho() + car_length/downstream->h);
-                        downstream->q[0].y()   = std::min(0.0f, arz<float>::eq::y(downstream->q[0].rho(), c.velocity,
-                                                                                  downstream->speedlimit()));
-                        assert(downstream->q[0].check());
-                        goto next_car;
-                    }
+        micro_swap(thr_id);
+        pool->barrier(thr_id);
 
-                    if (c.position >= 1.0)
-                        curr = downstream;
-                }
+        if(thr_id == 0)
+        {
+            lookahead_ready = false;
+            apply_roadblocks();
+        }
+        pool->barrier(thr_id);
 
-                assert(c.position < 1.0);
+        micro_integrate(thr_id, timestep);
+        pool->barrier(thr_id);
 
-                assert(destination_lane->is_micro());
-                destination_lane->next_cars().push_back(c);
+        micro_deliver(thr_id);
+        if(thr_id == 0)
+            apply_injections();
+        pool->barrier(thr_id);
+    }
 
-            next_car:;
-            }
+    struct micro_update_job : public thread_pool::job
+    {
+        micro_update_job(simulator &s, const float ts) : sim(s), timestep(ts)
+        {}
+
+        void operator()(const size_t thr_id, thread_pool &)
+        {
+            sim.micro_update(thr_id, timestep);
         }
+
+        simulator   &sim;
+        const float  timestep;
+    };
+
+    void simulator::update(const float timestep)
+    {
+        micro_update_job job(*this, timestep);
+        pool->run(job);
     }
 
     void simulator::micro_cleanup()
@@ -1,182 +1,273 @@
 #include "libhybrid/hybrid-sim.hpp"
+#include "libhybrid/task-graph.hpp"
 #include "libhybrid/timer.hpp"
 
-#ifdef _MSC_VER
-#include <windows.h>
-#undef max
-#undef min
-#endif
-
 namespace hybrid
 {
-    void simulator::parallel_hybrid_run(int nsteps)
+    struct step_phase;
+
+    // a hybrid step as a task_graph; see the constructor for what waits on what
+    struct hybrid_run_job : public thread_pool::job
     {
-        const float  cfl       = 1.0f;
-        const size_t max_thr   = omp_get_max_threads();
-        const size_t num_procs = omp_get_num_procs();
-        float        maxspeed;
-        float        dt;
-
-        float convert_time     = 0.0f;
-        float riemann_time     = 0.0f;
-        float max_compute_time = 0.0f;
-        float update_time      = 0.0f;
-        float micro_time       = 0.0f;
-
-        timer step_timer;
-        timer overall_timer;
-#pragma omp parallel
+        enum { SLOT_CONVERT, SLOT_RIEMANN, SLOT_UPDATE, SLOT_MICRO, NSLOTS };
+        enum { BUSY_STRIDE = 8 }; // doubles per thread, so threads don't share a line of busy
+
+        typedef void (hybrid_run_job::*item_fn)(size_t item, int arg);
+        typedef void (hybrid_run_job::*finish_fn)();
+        typedef bool (hybrid_run_job::*active_fn)(int arg) const;
+
+        hybrid_run_job(simulator &s, int n);
+        ~hybrid_run_job();
+
+        void operator()(const size_t thr_id, thread_pool &pool)
         {
-            const size_t thr_id = omp_get_thread_num();
-
-            worker &work = workers[thr_id];
-
-#ifdef _MSC_VER
-            DWORD_PTR mask = (1 << (thr_id % num_procs));
-            if(SetThreadAffinityMask( GetCurrentThread(), mask) == 0)
-                fprintf(stderr, "Couldn't set affinity for thread %d\n", thr_id);
-
-            if(SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) == 0)
-                fprintf(stderr, "Couldn't set realtime priority for thread %d\n", thr_id);
-#else
-            cpu_set_t mask;
-            CPU_ZERO(&mask);
-            CPU_SET((thr_id % num_procs), &mask);
-
-            if(sched_setaffinity(0, sizeof(mask), &mask) == -1)
-                std::cerr << "Couldn't set affinity for thread: " <<  thr_id << std::endl;
-            else
-                std::cerr << "Set affinity for thread: " <<  thr_id << std::endl;
-
-            struct sched_param sp;
-            sp.sched_priority = 10;
-            if(sched_setscheduler(0, SCHED_FIFO, &sp) == 0)
-                std::cerr << "Running with real-time priority (SCHED_FIFO)" << std::endl;
-            else
-                std::cerr << "Can't set SCHED_FIFO" << std::endl;
-#endif
-
-#pragma omp barrier
-#pragma omp single
-                {
-                    overall_timer.reset();
-                    overall_timer.start();
-                }
+            pool.barrier(thr_id);
+            if(thr_id == 0)
+            {
+                overall_timer.reset();
+                overall_timer.start();
+            }
 
             for(int i = 0; i < nsteps; ++i)
-            {
-                // fill in micro
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.reset();
-                    step_timer.start();
+                graph.run(thr_id, &busy[thr_id*BUSY_STRIDE]);
 
-                    convert_cars(MICRO);
+            pool.barrier(thr_id);
+            if(thr_id == 0)
+                overall_timer.stop();
+        }
 
-                    step_timer.stop();
-                    convert_time += step_timer.interval_S();
-                }
+        // total over the threads of the time spent in slot, per thread
+        double busy_time(const int slot) const
+        {
+            double res = 0.0;
+            for(size_t t = 0; t < sim.workers.size(); ++t)
+                res += busy[t*BUSY_STRIDE + slot];
+            return res/sim.workers.size();
+        }
 
-                // macro step (also emit cars)
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.reset();
-                    step_timer.start();
-                }
+        size_t add(item_fn item, size_t items, bool owned, int slot, int arg=0, finish_fn fin=0, active_fn act=0);
 
-                maxes[thr_id*MAXES_STRIDE] = 0.0f;
+        // items; those of owned phases are thread ids, micro ones are blocks of micro_blocks
+        void plan(size_t, int)
+        {
+            sim.plan_rebalance(false);
+            if(sim.macro_dataflow)
+                dt = sim.macro_flow_prepare(cfl, 1.0f);
+        }
+        void relayout(const size_t thr_id, int)  { if(sim.relayout_pending) sim.relayout(thr_id); }
+        void convert(const size_t i, int)        { sim.convert_cars(i, MICRO); }
+        void collect(const size_t thr_id, int)   { sim.macro_collect(thr_id); }
+        void pick_dt()
+        {
+            dt       = sim.macro_dt(cfl, 1.0f);
+            substeps = sim.macro_substeps(dt, cfl);
+        }
+        bool in_step(const int s) const          { return s < substeps; }
+        void substep_collect(const size_t thr_id, const int s) { sim.macro_substep_collect(thr_id, s, substeps); }
+        void substep_update(const size_t thr_id, const int s)
+        {
+            if(s == 0)
+                sim.macro_begin_update(thr_id, dt, cfl);
+            sim.macro_substep_update(thr_id, dt, s, substeps);
+        }
+        void reflux(const size_t thr_id, int)    { sim.macro_reflux(thr_id); }
+        void flow_seed(const size_t thr_id, int) { sim.macro_flow_seed(thr_id); }
+        void flow(const size_t thr_id, int)      { sim.macro_flow(thr_id, dt, 1); }
+        void macro_inflow(const size_t i, int)   { sim.apply_incoming_bc(i, MACRO, dt, sim.time + dt, sim.step + 1); }
+        void partition(size_t, int)
+        {
+            sim.micro_partition();
+            sim.build_lookahead();
+        }
+        void accelerations(const size_t b, int)  { sim.micro_accelerations(b, dt); }
+        void merges(const size_t b, int)         { sim.micro_merges(b, dt); }
+        void deliver(const size_t b, int)        { sim.micro_deliver(b); }
+        void swap(const size_t b, int)           { sim.micro_swap(b); }
+        void roadblocks(size_t, int)
+        {
+            sim.lookahead_ready = false;
+            sim.apply_roadblocks();
+        }
+        void integrate(const size_t b, int)      { sim.micro_integrate(b, dt); }
+        void injections(size_t, int)             { sim.apply_injections(); }
+        void micro_inflow(const size_t i, int)   { sim.apply_incoming_bc(i, MICRO, dt, sim.time + dt, sim.step + 1); }
+        void car_swap(const size_t b, int)       { sim.car_swap(b); }
+        void intersections(size_t, int)
+        {
+            sim.advance_intersections(dt);
+            sim.time += dt;
+            ++sim.step;
+        }
 
-                BOOST_FOREACH(lane *l, work.macro_lanes)
-                {
-                    assert(l->is_macro());
-                    assert(l->active());
-                    assert(!l->fictitious);
-                    const float max            = l->collect_riemann();
-                    maxes[thr_id*MAXES_STRIDE] = std::max(max, maxes[thr_id*MAXES_STRIDE]);
-                }
+        simulator                &sim;
+        const int                 nsteps;
+        const float               cfl;
+        float                     dt;
+        int                       substeps;
 
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.stop();
-                    riemann_time += step_timer.interval_S();
-                }
+        task_graph                graph;
+        std::vector<step_phase*>  phases;
+        std::vector<double>       busy;
+        timer                     overall_timer;
+    };
 
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.reset();
-                    step_timer.start();
+    struct step_phase : public task_graph::phase
+    {
+        step_phase(hybrid_run_job &j, const hybrid_run_job::item_fn i, const int a,
+                   const hybrid_run_job::finish_fn f, const hybrid_run_job::active_fn ac)
+            : job(j), item(i), arg(a), fin(f), act(ac)
+        {}
+
+        void run(const size_t i, size_t)
+        {
+            (job.*item)(i, arg);
+        }
 
-                    maxspeed     = 0.0f;
-                    for(size_t t = 0; t < max_thr; ++t)
-                        maxspeed = std::max(maxspeed, maxes[t*MAXES_STRIDE]);
+        void finish()
+        {
+            if(fin)
+                (job.*fin)();
+        }
 
-                    if(maxspeed < arz<float>::epsilon())
-                        maxspeed = min_h;
+        bool active() const
+        {
+            return !act || (job.*act)(arg);
+        }
 
-                    dt                = std::min(cfl*min_h/maxspeed, 1.0f);
-                    step_timer.stop();
-                    max_compute_time += step_timer.interval_S();
-                }
+        hybrid_run_job              &job;
+        hybrid_run_job::item_fn      item;
+        int                          arg;
+        hybrid_run_job::finish_fn    fin;
+        hybrid_run_job::active_fn    act;
+    };
 
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.reset();
-                    step_timer.start();
-                }
+    size_t hybrid_run_job::add(const item_fn item, const size_t items, const bool owned, const int slot,
+                               const int arg, const finish_fn fin, const active_fn act)
+    {
+        phases.push_back(new step_phase(*this, item, arg, fin, act));
+        return graph.add(*phases.back(), items, owned, slot);
+    }
 
-                BOOST_FOREACH(lane *l, work.macro_lanes)
-                {
-                    assert(l->is_macro());
-                    assert(l->active());
-                    assert(!l->fictitious);
-                    l->update(dt, *this);
-                }
+    hybrid_run_job::hybrid_run_job(simulator &s, const int n)
+        : sim(s), nsteps(n), cfl(1.0f), dt(0.0f), substeps(1),
+          graph(s.workers.size()), busy(s.workers.size()*BUSY_STRIDE, 0.0)
+    {
+        const size_t nthr = sim.workers.size();
+
+        const size_t plan_p = add(&hybrid_run_job::plan, 1, false, SLOT_CONVERT);
+        const size_t relayout_p = add(&hybrid_run_job::relayout, nthr, true, SLOT_CONVERT);
+        graph.after(relayout_p, plan_p);
+
+        // converting writes micro lanes and collecting reads macro ones, so the two overlap;
+        // the dt reduction is the last collect's finish() rather than a phase of its own
+        const size_t convert_p = add(&hybrid_run_job::convert, nthr, false, SLOT_CONVERT);
+        graph.after(convert_p, relayout_p);
+        size_t reflux_p;
+        if(sim.macro_dataflow)
+        {
+            // dt is known from plan; each thread then runs its lanes through the whole macro
+            // step, waiting only on neighbouring lanes (see simulator::macro_flow)
+            const size_t seed_p = add(&hybrid_run_job::flow_seed, nthr, true, SLOT_RIEMANN);
+            graph.after(seed_p, relayout_p);
+            reflux_p = add(&hybrid_run_job::flow, nthr, true, SLOT_UPDATE);
+            graph.after(reflux_p, seed_p);
+        }
+        else
+        {
+            const size_t collect_p = add(&hybrid_run_job::collect, nthr, true, SLOT_RIEMANN, 0, &hybrid_run_job::pick_dt);
+            graph.after(collect_p, relayout_p);
 
-#pragma omp barrier
-#pragma omp single
+            // a collect/update pair for each substep there could be; pick_dt decides how many run
+            size_t last = collect_p;
+            for(int st = 0; st < (1 << sim.macro_max_level); ++st)
+            {
+                if(st > 0)
                 {
-                    step_timer.stop();
-                    update_time += step_timer.interval_S();
+                    const size_t sub_collect_p = add(&hybrid_run_job::substep_collect, nthr, true, SLOT_RIEMANN, st, 0, &hybrid_run_job::in_step);
+                    graph.after(sub_collect_p, last);
+                    last = sub_collect_p;
                 }
 
-#pragma omp barrier
-#pragma omp single
-                {
-                    step_timer.reset();
-                    step_timer.start();
+                const size_t sub_update_p = add(&hybrid_run_job::substep_update, nthr, true, SLOT_UPDATE, st, 0, &hybrid_run_job::in_step);
+                graph.after(sub_update_p, last);
+                last = sub_update_p;
+            }
+            reflux_p = add(&hybrid_run_job::reflux, nthr, true, SLOT_UPDATE);
+            graph.after(reflux_p, last);
+        }
 
-                    // micro step
-                    update(dt);
+        // micro cars look ahead into macro lanes and macro lanes emit into micro ones,
+        // so the micro step starts once the macro one is done
+        const size_t partition_p = add(&hybrid_run_job::partition, 1, false, SLOT_MICRO);
+        graph.after(partition_p, reflux_p);
 
-                    time += dt;
-                    apply_incoming_bc(dt, time);
+        // macro inflow writes the first cell and the wet span of lanes at the edge of the network,
+        // which build_lookahead reads through macro_find_first; once the table is built micro cars
+        // only look down the chains micro lanes feed, which never lead back to the edge, so the
+        // rest of the micro step goes on alongside it
+        const size_t macro_inflow_p = add(&hybrid_run_job::macro_inflow, nthr, false, SLOT_UPDATE);
+        graph.after(macro_inflow_p, partition_p);
+        const size_t accelerations_p = add(&hybrid_run_job::accelerations, nthr, false, SLOT_MICRO);
+        graph.after(accelerations_p, partition_p);
+        graph.after(accelerations_p, convert_p);
+        const size_t merges_p = add(&hybrid_run_job::merges, nthr, false, SLOT_MICRO);
+        graph.after(merges_p, accelerations_p);
+        const size_t deliver_p = add(&hybrid_run_job::deliver, nthr, false, SLOT_MICRO);
+        graph.after(deliver_p, merges_p);
 
-                    car_swap();
-                    advance_intersections(dt);
+        // a block's lanes have all their cars once that block's deliver is done
+        const size_t swap_p = add(&hybrid_run_job::swap, nthr, false, SLOT_MICRO);
+        graph.after_item(swap_p, deliver_p);
+        const size_t roadblocks_p = add(&hybrid_run_job::roadblocks, 1, false, SLOT_MICRO);
+        graph.after(roadblocks_p, swap_p);
+        const size_t integrate_p = add(&hybrid_run_job::integrate, nthr, false, SLOT_MICRO);
+        graph.after(integrate_p, roadblocks_p);
+        const size_t transfers_p = add(&hybrid_run_job::deliver, nthr, false, SLOT_MICRO);
+        graph.after(transfers_p, integrate_p);
+        const size_t injections_p = add(&hybrid_run_job::injections, 1, false, SLOT_MICRO);
+        graph.after(injections_p, integrate_p);
+        const size_t micro_inflow_p = add(&hybrid_run_job::micro_inflow, nthr, false, SLOT_MICRO);
+        graph.after(micro_inflow_p, transfers_p);
+        const size_t car_swap_p = add(&hybrid_run_job::car_swap, nthr, false, SLOT_MICRO);
+        graph.after(car_swap_p, micro_inflow_p);
 
-                    step_timer.stop();
-                    micro_time += step_timer.interval_S();
-                }
-            }
+        // intersections read whether lanes are occupied, so they go last
+        const size_t intersections_p = add(&hybrid_run_job::intersections, 1, false, SLOT_MICRO);
+        graph.after(intersections_p, car_swap_p);
+        graph.after(intersections_p, injections_p);
+        graph.after(intersections_p, macro_inflow_p);
+    }
 
-#pragma omp barrier
-#pragma omp single
-                {
-                    overall_timer.stop();
-                }
+    hybrid_run_job::~hybrid_run_job()
+    {
+        for(size_t i = 0; i < phases.size(); ++i)
+            delete phases[i];
+    }
 
-        }
-        printf("convert = %015.10lf\n", convert_time);
-        printf("riemann = %015.10lf\n", riemann_time);
-        printf("max     = %015.10lf\n", max_compute_time);
-        printf("update  = %015.10lf\n", update_time);
-        printf("micro   = %015.10lf\n", micro_time);
+    void simulator::parallel_hybrid_run(int nsteps)
+    {
+        assert(pool->size() == workers.size());
+
+        hybrid_run_job job(*this, nsteps);
+        pool->run(job);
+
+        if(macro_dataflow && macro_flow_overruns() > 0)
+            throw std::runtime_error("Macro flow outran a lane's rate bound!");
+
+        // time each thread spent working in each part of the step, on average; parts overlap,
+        // and idle is what's left of the total
+        const double total   = job.overall_timer.interval_S();
+        const double convert = job.busy_time(hybrid_run_job::SLOT_CONVERT);
+        const double riemann = job.busy_time(hybrid_run_job::SLOT_RIEMANN);
+        const double update  = job.busy_time(hybrid_run_job::SLOT_UPDATE);
+        const double micro   = job.busy_time(hybrid_run_job::SLOT_MICRO);
+
+        printf("convert = %015.10lf\n", convert);
+        printf("riemann = %015.10lf\n", riemann);
+        printf("update  = %015.10lf\n", update);
+        printf("micro   = %015.10lf\n", micro);
+        printf("idle    = %015.10lf\n", total - convert - riemann - update - micro);
         printf("--------------------\n");
-        printf("tot. time = %015.10lf\n", overall_timer.interval_S());
+        printf("tot. time = %015.10lf\n", total);
     }
 }
@@ -7,7 +7,10 @@ namespace hybrid
     }
 
     lane::serial_state::serial_state(const lane &l) : cars(l.current_cars()),
-                                                      sim_type(l.sim_type)
+                                                      sim_type(l.sim_type),
+                                                      car_serial(l.car_serial),
+                                                      h(l.h),
+                                                      N(l.N)
     {
         assert(l.next_cars().empty());
     }
@@ -16,20 +19,20 @@ namespace hybrid
     {
         l.sim_type       = sim_type;
         l.current_cars() = cars;
+        l.car_serial     = car_serial;
+        l.h              = h;
+        l.inv_h          = h > 0.0f ? 1.0f/h : 0.0f;
+        l.h_next         = h;
+        l.N              = N;
+        l.index_cars();
     }
 
-    lane::lane() : parent(0), N(0), q(0), up_aux(0), down_aux(0), rs(0)
+    lane::lane() : parent(0), car_serial(0), micro_owner(0), h(0.0f), inv_h(0.0f), N(0), q(0), up_aux(0), down_aux(0),
+                   wet_begin(0), wet_end(0), sweep_begin(0), sweep_end(0), h_next(0.0f), rate(0.0f), level(0),
+                   rate_bound(0.0f), flow_next(0), emitted(0)
     {
     }
 
-    lane::~lane()
-    {
-        if(down_aux)
-            free(down_aux);
-        if(up_aux)
-            free(up_aux);
-    }
-
     void lane::initialize(hwm::lane *in_parent)
     {
         parent             = in_parent;
@@ -50,7 +53,67 @@ namespace hybrid
     {
         cars[0].swap(cars[1]);
         cars[1].clear();
-        std::sort(cars[0].begin(), cars[0].end(), car_sort());
+
+        // next_cars() is this lane's own cars, in one order or the other,
+        // plus a few arrivals. Find the longest monotone run, sort what's
+        // left over and merge the two; a lane that is already in order costs
+        // one linear scan.
+        std::vector<car> &c = cars[0];
+        const size_t      n = c.size();
+        size_t best_begin = 0;
+        size_t best_end   = 0;
+        for(size_t begin = 0; begin < n;)
+        {
+            size_t end = begin + 1;
+            if(end < n && c[end].position < c[begin].position)
+            {
+                while(end < n && c[end].position < c[end-1].position)
+                    ++end;
+                std::reverse(c.begin() + begin, c.begin() + end);
+            }
+            else
+            {
+                while(end < n && !(c[end].position < c[end-1].position))
+                    ++end;
+            }
+
+            if(end - begin > best_end - best_begin)
+            {
+                best_begin = begin;
+                best_end   = end;
+            }
+            begin = end;
+        }
+
+        if(best_end - best_begin < n)
+        {
+            std::vector<car> rest;
+            rest.reserve(n - (best_end - best_begin));
+            rest.insert(rest.end(), c.begin(),            c.begin() + best_begin);
+            rest.insert(rest.end(), c.begin() + best_end, c.end());
+            std::sort(rest.begin(), rest.end(), car_sort());
+
+            // the old current cars are dead; reuse their storage for the merge
+            std::vector<car> &merged = cars[1];
+            merged.resize(n);
+            std::merge(c.begin() + best_begin, c.begin() + best_end,
+                       rest.begin(), rest.end(),
+                       merged.begin(), car_sort());
+            c.swap(merged);
+            merged.clear();
+        }
+
+        index_cars();
+    }
+
+    void lane::index_cars()
+    {
+        merging_in.clear();
+        for(size_t i = 0; i < current_cars().size(); ++i)
+        {
+            if(current_car(i).other_lane_membership.other_lane)
+                merging_in.push_back(i);
+        }
     }
 
     bool lane::is_micro() const
@@ -70,7 +133,7 @@ namespace hybrid
         case MICRO:
             return !current_cars().empty() || !next_cars().empty();
         case MACRO:
-            for(size_t i = 0; i < N; ++i)
+            for(size_t i = wet_begin; i < wet_end; ++i)
             {
                 if(q[i].rho() > 3*arz<float>::epsilon())
                     return true;
@@ -142,6 +205,31 @@ namespace hybrid
         }
     }
 
+    bool lane::leading_vehicle(float &distance, float &vel, const simulator &sim) const
+    {
+        switch(sim_type)
+        {
+        case MICRO:
+            if(current_cars().empty())
+                return false;
+            vel      = current_cars().front().velocity;
+            distance = current_cars().front().position*length;
+            return true;
+        case MACRO:
+            {
+                float param;
+                if(fictitious || !macro_find_first(param, sim))
+                    return false;
+                vel      = velocity(param);
+                distance = param*length;
+                return true;
+            }
+        default:
+            assert(0);
+            return false;
+        }
+    }
+
     simulator::serial_state::serial_state()
     {
     }
@@ -150,8 +238,7 @@ namespace hybrid
     {
     }
 
-    simulator::serial_state::serial_state(const simulator &s) : car_id_counter(s.car_id_counter),
-                                                                generator(*s.generator),
+    simulator::serial_state::serial_state(const simulator &s) : step(s.step),
                                                                 network_state(s.hnet->serial())
     {
         lane_states.reserve(s.lanes.size());
@@ -198,8 +285,8 @@ namespace hybrid
         micro_lanes.insert(micro_lanes.end(), w.micro_lanes.begin(), w.micro_lanes.end());
 
         N      = w.N;
-        q_base = (arz<float>::q *)malloc(sizeof(arz<float>::q) * N);
-        std::memcpy(q_base, w.q_base, sizeof(arz<float>::q) * N);
+        q_base = (arz<float>::q *)malloc(sizeof(arz<float>::q) * w.q_size());
+        std::memcpy(q_base, w.q_base, sizeof(arz<float>::q) * w.q_size());
     }
 
     worker::serial_state::~serial_state()
@@ -225,23 +312,25 @@ namespace hybrid
         }
         if(w.q_base)
             free(w.q_base);
-        w.N      = N;
-        w.q_base = (arz<float>::q *)malloc(sizeof(arz<float>::q) * w.N);
-        std::memcpy(w.q_base, q_base, sizeof(arz<float>::q) * N);
+        if(w.q_saved)
+            free(w.q_saved);
+        w.q_saved = 0;
+        w.N       = N;
+        w.q_base  = (arz<float>::q *)malloc(sizeof(arz<float>::q) * w.q_size());
+        std::memcpy(w.q_base, q_base, sizeof(arz<float>::q) * w.q_size());
     }
 
     worker::worker()
         : q_base(0),
           N(0),
-          rs_base(0)
+          stream_base(0),
+          q_saved(0),
+          flow_overruns(0)
     {}
 
     worker::~worker()
     {
-        if(q_base)
-            free(q_base);
-        if(rs_base)
-            free(rs_base);
+        release();
     }
 
     worker::serial_state worker::serial() const
@@ -251,9 +340,9 @@ namespace hybrid
 
     void simulator::serial_state::apply(simulator &s) const
     {
-        s.car_id_counter = car_id_counter;
-        *s.generator     = generator;
+        s.step = step;
         network_state.apply(*s.hnet);
+        s.build_links();
     }
 
     simulator::simulator(hwm::network *net, float length, float rear_axle)
@@ -261,12 +350,30 @@ namespace hybrid
           car_length(length),
           rear_bumper_rear_axle(rear_axle),
           time(0.0f),
-          car_id_counter(1)
+          seed(42ul),
+          step(0),
+          lookahead_ready(false),
+          remesh_step(0),
+          macro_max_level(0),
+          rebalance_dirty(false),
+          rebalance_threshold(1.25f),
+          graph_partition(true),
+          partition_imbalance(0.05f),
+          huge_pages(false),
+          numa_bind(false),
+          macro_dataflow(false),
+          cfl_safety(0.8f),
+          cfl_rollbacks(0),
+          lagged_attempt(-1),
+          fixed_block(8),
+          fixed_tile(1024),
+          flows(0),
+          flows_dirty(true),
+          flow_dt(0.0f),
+          flow_cfl(0.0f),
+          flow_max_dt(0.0f),
+          relayout_pending(false)
     {
-        generator = new base_generator_type(42ul);
-        uni_dist  = new boost::uniform_real<>(0,1);
-        uni       = new boost::variate_generator<base_generator_type&, boost::uniform_real<> >(*generator, *uni_dist);
-
         assert(hnet);
 
         // figure out how many lanes to create
@@ -316,19 +423,30 @@ namespace hybrid
         }
         std::cout << "Min length of fict lane  is: " << min_len << std::endl;
 
+        build_links();
+
         const int max_thr = omp_get_max_threads();
         std::cout << "Making " << max_thr << " workers" << std::endl;
         workers.resize(max_thr);
+        pool = new thread_pool(max_thr);
     }
 
     simulator::~simulator()
     {
-        delete generator;
-        delete uni_dist;
-        delete uni;
-
         micro_cleanup();
         macro_cleanup();
+
+        delete pool;
+    }
+
+    void simulator::set_topology(const std::vector<int> &cpu_map, const bool realtime)
+    {
+        delete pool;
+        pool = new thread_pool(workers.size(), cpu_map, realtime);
+
+        // worker storage sits where the old threads touched it; have the new ones take it over
+        if(workers[0].q_base)
+            rebalance(true);
     }
 
     float simulator::rear_bumper_offset() const
@@ -349,10 +467,70 @@ namespace hybrid
         }
     }
 
-    car simulator::make_car(const float position, const float velocity,
+    void simulator::car_swap(const size_t thr_id)
+    {
+        for(size_t i = micro_blocks[thr_id]; i < micro_blocks[thr_id+1]; ++i)
+            micro_lanes[i]->car_swap();
+    }
+
+    car simulator::make_car(lane &origin, const float position, const float velocity,
                             const float acceleration)
     {
-        return car(car_id_counter++, position, velocity, acceleration);
+        // ids are unique without a shared counter: serial*nlanes + lane + 1 (0 is left for temporaries)
+        const size_t id = origin.car_serial++*lanes.size() + lane_index(origin) + 1;
+        return car(id, position, velocity, acceleration);
+    }
+
+    simulator::rand_gen_t simulator::rng(const lane &l, const rng_purpose_t purpose) const
+    {
+        return rng(l, purpose, step);
+    }
+
+    simulator::rand_gen_t simulator::rng(const lane &l, const rng_purpose_t purpose, const size_t at_step) const
+    {
+        return rand_gen_t(seed, static_cast<uint32_t>(lane_index(l)), static_cast<uint32_t>(at_step), purpose);
+    }
+
+    simulator::rand_gen_t simulator::rng(const lane &l, const rng_purpose_t purpose, const size_t at_step, const int substep) const
+    {
+        // purposes fit in the low byte; a lane subcycling within a step draws afresh on each substep
+        return rand_gen_t(seed, static_cast<uint32_t>(lane_index(l)), static_cast<uint32_t>(at_step),
+                          purpose | (static_cast<uint32_t>(substep) << 8));
+    }
+
+    size_t simulator::lane_index(const lane &l) const
+    {
+        assert(&l >= &lanes[0] && &l < &lanes[0] + lanes.size());
+        return &l - &lanes[0];
+    }
+
+    static int link_index(const simulator &s, const lane *l)
+    {
+        return l ? static_cast<int>(s.lane_index(*l)) : -1;
+    }
+
+    void simulator::build_links()
+    {
+        links.resize(lanes.size());
+        for(size_t i = 0; i < lanes.size(); ++i)
+        {
+            const lane *l          = &lanes[i];
+            const lane *upstream   = l->upstream_lane();
+            const lane *downstream = l->downstream_lane();
+            lane_link  &ln         = links[i];
+
+            ln.upstream              = link_index(*this, upstream);
+            ln.downstream            = link_index(*this, downstream);
+            ln.upstream_through      = link_index(*this, upstream && upstream->fictitious ? upstream->upstream_lane() : upstream);
+            ln.downstream_through    = link_index(*this, downstream && downstream->fictitious ? downstream->downstream_lane() : downstream);
+            ln.speedlimit            = l->speedlimit();
+            ln.upstream_speedlimit   = upstream   ? upstream->speedlimit()   : 0.0f;
+            ln.downstream_speedlimit = downstream ? downstream->speedlimit() : 0.0f;
+            ln.start_boundary        = l->parent->start->network_boundary();
+            ln.end_boundary          = l->parent->end->network_boundary();
+        }
+
+        flows_dirty = true;
     }
 
     lane &simulator::get_lane_by_name(const str &s)
@@ -446,6 +624,7 @@ namespace hybrid
         update(dt);
 
         time += dt;
+        ++step;
         apply_incoming_bc(dt, time);
 
         car_swap();
@@ -462,7 +641,10 @@ namespace hybrid
         assert(l.next_cars().empty());
 
         if(!l.fictitious)
+        {
             l.macro_instantiate(*this);
+            rebalance_dirty = true;
+        }
 
         std::vector<lane*>::iterator loc = std::find(macro_lanes.begin(),
                                                      macro_lanes.end(),
@@ -475,6 +657,7 @@ namespace hybrid
 
         micro_lanes.push_back(&l);
         l.sim_type = MICRO;
+        flows_dirty = true;
     }
 
     void simulator::convert_to_macro(lane &l)
@@ -482,7 +665,8 @@ namespace hybrid
         if(l.sim_type == MACRO)
             return;
 
-        l.sim_type = MACRO;
+        l.sim_type  = MACRO;
+        flows_dirty = true;
 
         std::vector<lane*>::iterator loc = std::find(micro_lanes.begin(),
                                                      micro_lanes.end(),
@@ -496,18 +680,19 @@ namespace hybrid
         if(!l.fictitious)
         {
             macro_lanes.push_back(&l);
+            rebalance_dirty = true;
 
-            l.clear_macro();
             l.convert_cars(*this);
-            l.fill_y();
         }
 
         l.current_cars().clear();
         l.next_cars().clear();
+        l.merging_in.clear();
     }
 
     void simulator::advance_intersections(float dt)
     {
+        bool changed = false;
         BOOST_FOREACH(hwm::intersection_pair &ip, hnet->intersections)
         {
             hwm::intersection &i = ip.second;
@@ -529,11 +714,15 @@ namespace hybrid
                 {
                     i.unlock();
                     i.advance_state();
+                    changed = true;
                 }
                 else
                     i.lock();
             }
         }
+
+        if(changed)
+            build_links();
     }
 
     static float bump(float x)
@@ -559,58 +748,81 @@ namespace hybrid
 
     void simulator::apply_incoming_bc(float dt, float t)
     {
-        static const float MIN_SPEED_FRACTION = 0.7;
-        const float rate                      = tod_car_rate(std::fmod(t, 24.0f*60.0f*60.0f));
+        const float rate = tod_car_rate(std::fmod(t, 24.0f*60.0f*60.0f));
         BOOST_FOREACH(lane &l, lanes)
         {
-            if(!l.parent->start->network_boundary())
-                continue;
+            apply_incoming_bc(l, dt, rate, step);
+        }
+    }
 
-            bool add_car = false;
-            float cand_rho;
-            if(l.is_micro())
-            {
-                if(l.current_cars().empty())
-                    add_car = true;
-                else if(l.current_car(0).position * l.length > 2*car_length)
-                    add_car = true;
-            }
-            else
-            {
-                cand_rho = l.q[0].rho() + car_length/l.h;
-                if(cand_rho < 0.95)
-                    add_car = true;
-            }
+    void simulator::apply_incoming_bc(const size_t thr_id, const float dt, const float t)
+    {
+        apply_incoming_bc(thr_id, static_cast<sim_t>(MICRO | MACRO), dt, t, step);
+    }
 
-            if(!add_car)
-                continue;
+    void simulator::apply_incoming_bc(const size_t thr_id, const sim_t sim_mask, const float dt, const float t, const size_t at_step)
+    {
+        const float  rate = tod_car_rate(std::fmod(t, 24.0f*60.0f*60.0f));
+        const size_t nthr = workers.size();
+        for(size_t i = thr_id; i < lanes.size(); i += nthr)
+        {
+            if(lanes[i].sim_type & sim_mask)
+                apply_incoming_bc(lanes[i], dt, rate, at_step);
+        }
+    }
 
-            const float add_prob     = (*uni)();
-            const float prob_of_none = std::exp(-rate*dt);
-            if(add_prob <= prob_of_none)
-                continue;
+    void simulator::apply_incoming_bc(lane &l, const float dt, const float rate, const size_t at_step)
+    {
+        static const float MIN_SPEED_FRACTION = 0.7;
+        if(!link(l).start_boundary)
+            return;
+
+        bool add_car = false;
+        float cand_rho;
+        if(l.is_micro())
+        {
+            if(l.current_cars().empty())
+                add_car = true;
+            else if(l.current_car(0).position * l.length > 2*car_length)
+                add_car = true;
+        }
+        else
+        {
+            cand_rho = l.q[0].rho() + car_length/l.h;
+            if(cand_rho < 0.95)
+                add_car = true;
+        }
+
+        if(!add_car)
+            return;
 
-            if(l.is_micro())
+        rand_gen_t  r(rng(l, RNG_INFLOW, at_step));
+        const float add_prob     = r();
+        const float prob_of_none = std::exp(-rate*dt);
+        if(add_prob <= prob_of_none)
+            return;
+
+        if(l.is_micro())
+        {
+            car new_car;
+            if(l.current_cars().empty())
             {
-                car new_car;
-                if(l.current_cars().empty())
-                {
-                    new_car = make_car(0, std::max((float)(*uni)(), MIN_SPEED_FRACTION)*l.speedlimit(), 0);
-                    new_car.compute_intersection_acceleration(*this, l);
-                }
-                else
-                {
-                    const car &leader = l.current_car(0);
-                    new_car           = make_car(0, leader.velocity, 0);
-                    new_car.compute_acceleration(leader, (leader.position - new_car.position)*l.length, *this);
-                }
-                l.next_cars().push_back(new_car);
+                new_car = make_car(l, 0, std::max((float)r(), MIN_SPEED_FRACTION)*l.speedlimit(), 0);
+                new_car.compute_intersection_acceleration(*this, l);
             }
             else
             {
-                arz<float>::full_q fq(l.q[0], l.speedlimit());
-                l.q[0] = arz<float>::q(cand_rho, 0.5*(fq.u()+std::max((float)(*uni)(), MIN_SPEED_FRACTION)*l.speedlimit()), l.speedlimit());
+                const car &leader = l.current_car(0);
+                new_car           = make_car(l, 0, leader.velocity, 0);
+                new_car.compute_acceleration(leader, (leader.position - new_car.position)*l.length, *this);
             }
+            l.next_cars().push_back(new_car);
+        }
+        else
+        {
+            arz<float>::full_q fq(l.q[0], l.speedlimit());
+            l.q[0] = arz<float>::q(cand_rho, 0.5*(fq.u()+std::max((float)r(), MIN_SPEED_FRACTION)*l.speedlimit()), l.speedlimit());
+            l.mark_wet(0);
         }
     }
 
@@ -1,9 +1,14 @@
 #include "libroad/hwm_network.hpp"
 #include "libhybrid/libhybrid-common.hpp"
 #include "libhybrid/arz.hpp"
+#include "libhybrid/arz-simd.hpp"
 #include "libhybrid/pc-poisson.hpp"
 #include "libhybrid/allocate.hpp"
-#include <boost/random.hpp>
+#include "libhybrid/thread-pool.hpp"
+#include "libhybrid/partition.hpp"
+#include "libhybrid/philox.hpp"
+#include "libhybrid/car-following.hpp"
+#include <boost/next_prior.hpp>
 #include <set>
 #include <omp.h>
 #include <algorithm>
@@ -12,8 +17,21 @@ namespace hybrid
 {
     typedef enum {MACRO=1, MICRO=2} sim_t;
 
+    // car-following model, fixed at compile time
+#if defined(HYBRID_GIPPS)
+    typedef gipps  car_following_t;
+#elif defined(HYBRID_KRAUSS)
+    typedef krauss car_following_t;
+#else
+    typedef idm<4> car_following_t;
+#endif
+
+    /** What a random stream is drawn for; part of the stream's key. */
+    typedef enum {RNG_INSTANTIATE=1, RNG_POPULATE, RNG_INFLOW, RNG_FIND_FIRST, RNG_FIND_LAST} rng_purpose_t;
+
     struct simulator;
     struct lane;
+    struct worker;
 
     struct car
     {
@@ -48,6 +66,7 @@ namespace hybrid
         void find_free_dist_and_vel(const lane& l, float& next_velocity, float& distance, const simulator& sim);
         void compute_intersection_acceleration(const simulator &sim, const lane &l);
         void integrate(float timestep, const lane &l, float lane_width);
+        void integrate_merge(float timestep, float lane_width);
         void check_if_valid_acceleration(lane& l, float timestep);
         float check_lane(const lane* l, const float param, const float timestep, const simulator& sim);
         mat4x4f point_frame(const hwm::lane *l, float lane_width) const;
@@ -56,6 +75,47 @@ namespace hybrid
         // macro data
     };
 
+    /** The first vehicle ahead of the start of a lane, as lane::distance_to_car would find it.
+     *  Built once per step by simulator::build_lookahead, for the lanes
+     *  micro lanes feed and the chains behind them, so the lead car of a
+     *  lane doesn't walk the downstream chain itself.
+     */
+    struct lookahead
+    {
+        lookahead() : distance(0.0f), velocity(0.0f), reach(0.0f), walked(false), capped(false), mark(0) {}
+
+        /** Answer a distance_to_car query from the entry.
+         *  \param[in,out] dist Distance walked so far on entry; distance to the vehicle on exit.
+         *  \param[out] vel Velocity of the vehicle.
+         *  \param[in] dist_max Query horizon.
+         *  \returns false if the entry can't answer the query and the caller must walk.
+         */
+        bool query(float &dist, float &vel, const float dist_max) const
+        {
+            if(mark != 2 || dist < 0.0f)
+                return false;
+
+            if(capped || (walked && dist + reach >= dist_max))
+            {
+                vel  = 0.0f;
+                dist = dist_max;
+            }
+            else
+            {
+                vel   = velocity;
+                dist += distance;
+            }
+            return true;
+        }
+
+        float distance; /**< From the lane start to the vehicle, or to the end of the chain.*/
+        float velocity; /**< Of the vehicle; 0 if the chain ended without one.*/
+        float reach;    /**< Length of the empty lanes walked before stopping.*/
+        bool  walked;   /**< Whether any empty lane was walked at all.*/
+        bool  capped;   /**< Walk ended at a network boundary or went round a loop of empty lanes.*/
+        int   mark;     /**< 0 not built, 1 being built, 2 built.*/
+    };
+
     struct car_interp
     {
         struct car_spatial
@@ -97,10 +157,12 @@ namespace hybrid
 
             std::vector<car> cars;
             sim_t            sim_type;
+            size_t           car_serial;
+            float            h;
+            size_t           N;
         };
 
         lane();
-        ~lane();
 
         // common data
         void                     initialize(hwm::lane *parent);
@@ -117,6 +179,7 @@ namespace hybrid
 
         size_t                  ncars()     const { return current_cars().size(); }
         void                    car_swap();
+        void                    index_cars();
         bool                    is_micro()  const;
         bool                    is_macro()  const;
         bool                    occupied()  const;
@@ -140,39 +203,97 @@ namespace hybrid
         sim_t             sim_type;
         bool              updated_flag;
         bool              fictitious;
+        size_t            car_serial; // cars created by this lane; see simulator::make_car
 
         void distance_to_car(float &distance, float &velocity, const float distance_max, const simulator &sim) const;
+        bool leading_vehicle(float &distance, float &velocity, const simulator &sim) const;
+
+        lookahead ahead;
 
         // micro data
         void  micro_distance_to_car(float &distance, float &velocity, const float distance_max, const simulator &sim) const;
+        void  compute_car_acceleration(size_t i, const car *leader, const simulator &sim);
+        void  apply_merge_limits(size_t i, const simulator &sim);
+        void  integrate_cars(float timestep, float lane_width);
         void  compute_lane_accelerations(float timestep, const simulator &sim);
         float settle_pass(const float timestep, const float epsilon, const float epsilon_2, const simulator &sim);
-        void  compute_merges(const float timestep, const simulator& sim);
+        void  compute_merges(const float timestep, const simulator& sim, worker &out);
         car&  find_next_car(float param);
         car   get_merging_leader(float param, const lane* other_lane);
         void  apply_roadblock(float p, simulator &s);
 
+        size_t              micro_owner;
+        std::vector<float>  micro_scratch; // leader and follower streams for the batched car-following kernel
+        std::vector<size_t> merging_in; // indices into current_cars() of cars still merging in from a neighbour
+
         // macro data
         void  macro_initialize(const float h_suggest);
         void  macro_instantiate(simulator &sim);
         bool  macro_find_first(float &param, const simulator &sim) const;
-        bool  macro_find_last(float &param, const simulator &sim) const;
+        bool  macro_find_last(float &param, const simulator &sim, size_t at_step, int substep) const;
         void  macro_distance_to_car(float &distance, float &velocity, const float distance_max, const simulator &sim) const;
         int   which_cell(float pos) const;
         float velocity(float pos) const;
-        float collect_riemann();
-        void  update         (const float dt,    simulator  &sim);
+        float solve_upstream_end(const simulator &sim, const arz_streams &s, const arz<float>::q &ghost, arz<float>::q &flux) const;
+        float solve_downstream_end(const simulator &sim, const arz_streams &s, size_t end, const arz<float>::q &ghost, arz<float>::q &flux) const;
+        float collect_riemann(simulator &sim);
+        float fixed_step(const simulator &sim, arz<float>::q *cells, arz_streams s, size_t n, bool at_start, bool at_end,
+                         const arz<float>::q &up, const arz<float>::q &down, float dt) const;
+        void  pull_ghosts(simulator &sim);
+        void  pull_flow_ghosts(simulator &sim, int64_t t);
+        void  pull_sent_ghosts(simulator &sim, int parity);
+        void  send_ends(int parity);
+        void  update         (const float dt,    simulator  &sim, size_t at_step, int substep);
+        void  reflux(simulator &sim);
+        lane *upstream_macro(simulator &sim);
+        lane *downstream_macro(simulator &sim);
         void  clear_macro();
         void  convert_cars(const simulator &sim);
         void  fill_y();
+        void  find_wet();
+        void  mark_wet(size_t i);
+        size_t active_cells() const;
 
         float                         h;
         float                         inv_h;
         size_t                        N;
         arz<float>::q                *q;
-        arz<float>::q                *up_aux;
+        arz<float>::q                *up_aux;   // ghost cells either side of q, filled by pull_ghosts
         arz<float>::q                *down_aux;
-        arz<float>::riemann_solution *rs;
+        arz_streams                   qs;
+        size_t                        wet_begin;   // every cell outside [wet_begin, wet_end) is vacuum
+        size_t                        wet_end;
+        size_t                        sweep_begin; // cells the last collect_riemann solved
+        size_t                        sweep_end;
+
+        float                         h_next;   // cell size picked by simulator::remesh, applied by rebalance
+        float                         rate;     // fastest wave speed over h, from the last collect_riemann
+        int                           level;    // this step is taken in 2^level substeps
+        arz<float>::q                 flux_in;  // interface fluxes from the last collect_riemann
+        arz<float>::q                 flux_out;
+        arz<float>::q                 inflow;   // the same, integrated over the substeps of this step
+        arz<float>::q                 outflow;
+        float                         rate_bound; // most rate can be, from the speed limits; see simulator::macro_flow_prepare
+        int64_t                       flow_next;  // time of this lane's next action in simulator::macro_flow
+        arz<float>::q                 sent_first[2]; // end cells for lagged substeps of each parity to read; see send_ends
+        arz<float>::q                 sent_last[2];
+        size_t                        emitted;  // cars update has sent downstream since the lagged step began
+    };
+
+    struct car_transfer
+    {
+        car_transfer(lane *in_dest, const car &in_c) : dest(in_dest), c(in_c) {}
+
+        lane *dest;
+        car   c;
+    };
+
+    struct macro_injection
+    {
+        macro_injection(lane *in_dest, const float in_velocity) : dest(in_dest), velocity(in_velocity) {}
+
+        lane  *dest;
+        float  velocity;
     };
 
     struct worker
@@ -193,7 +314,18 @@ namespace hybrid
 
         worker();
         ~worker();
-        void macro_initialize();
+        void   macro_initialize(bool huge_pages, bool numa_bind);
+        void   allocate(bool huge_pages, bool numa_bind);
+        void   bind();
+        void   release();
+        size_t active_cells() const;
+        size_t bytes() const;
+        size_t q_size() const { return N + 2*macro_lanes.size(); } // cells plus each lane's two ghosts
+
+        void send(lane *dest, const car &c)
+        {
+            outbox[dest->micro_owner].push_back(car_transfer(dest, c));
+        }
 
         serial_state serial() const;
 
@@ -203,7 +335,128 @@ namespace hybrid
         arz<float>::q                *q_base;
         arz<float>::q                *q_aux;
         size_t                        N;
-        arz<float>::riemann_solution *rs_base;
+        float                        *stream_base;
+        arz<float>::q                *q_saved;       // q_base as a lagged step found it, for rolling back
+
+        // macro_fixed_run; lanes' end bands, then a tile and its halo, its streams, and the halo
+        // the next tile needs from before this one was written back, and a lane's ghosts by step
+        std::vector<arz<float>::q>    fixed_bands;
+        std::vector<arz<float>::q>    fixed_cells;
+        std::vector<float>            fixed_streams;
+        std::vector<arz<float>::q>    fixed_carry;
+        std::vector<arz<float>::q>    fixed_ghosts;
+
+        // macro_flow; substeps whose rate went past their lane's rate_bound, until macro_flow_overruns takes them
+        size_t                        flow_overruns;
+
+        // micro; cars bound for other lanes, by thread owning the destination
+        std::vector<std::vector<car_transfer> > outbox;
+        std::vector<macro_injection>            injections;
+    };
+
+    /** How lanes are cut into cells for the macro simulation.
+     *  The defaults give every lane h_suggest. A reference speed scales h
+     *  with the speed limit so lanes' CFL limits are closer together, and
+     *  the jump thresholds let simulator::remesh halve or double h of a lane
+     *  as the steepest density jump between its cells goes above or below them.
+     */
+    struct cell_sizing
+    {
+        cell_sizing();
+
+        /** Cell size for a lane when the macro simulation is set up.
+         *  \param l The lane.
+         *  \param h_suggest The cell size for a lane at reference_speed.
+         *  \returns The cell size, within [h_min, h_max].
+         */
+        float initial_h(const lane &l, float h_suggest) const;
+
+        /** Cell size for a lane given its current densities.
+         *  \param l A macro lane.
+         *  \returns Half, twice or exactly l.h, within [h_min, h_max].
+         */
+        float remesh_h(const lane &l) const;
+
+        bool  adaptive() const { return refine_jump > 0.0f; }
+
+        float  h_min;           /**< No lane is cut finer than this.*/
+        float  h_max;           /**< No lane is cut coarser than this.*/
+        float  reference_speed; /**< Speed limit that gets h_suggest; 0 ignores the speed limit.*/
+        size_t min_cells;       /**< Fewest cells any lane gets.*/
+        float  refine_jump;     /**< Density jump between neighbouring cells that halves h; 0 never remeshes.*/
+        float  coarsen_jump;    /**< Steepest jump a lane may have to have its h doubled.*/
+        size_t remesh_interval; /**< Steps between remesh checks.*/
+    };
+
+    /** A lane's connectivity, flattened out of libroad for the inner loops.
+     *  Neighbours are indices into simulator::lanes, -1 for none. The
+     *  table depends on intersection states, so simulator::build_links
+     *  rebuilds it whenever one changes.
+     */
+    struct lane_link
+    {
+        int   upstream;              /**< The lane feeding this one.*/
+        int   downstream;            /**< The lane this one feeds.*/
+        int   upstream_through;      /**< upstream, or what feeds it if it's fictitious.*/
+        int   downstream_through;    /**< downstream, or what it feeds if it's fictitious.*/
+        float speedlimit;            /**< This lane's speed limit.*/
+        float upstream_speedlimit;   /**< upstream's speed limit.*/
+        float downstream_speedlimit; /**< downstream's speed limit.*/
+        bool  start_boundary;        /**< Whether this lane starts at the edge of the network.*/
+        bool  end_boundary;          /**< Whether this lane ends at the edge of the network.*/
+    };
+
+    /** A macro lane's end cells as it published them for its neighbours.
+     */
+    struct lane_ends
+    {
+        arz<float>::q first;
+        arz<float>::q last;
+        int64_t       from;  /**< Time of the action that left these ends.*/
+        int64_t       until; /**< Time of the lane's next action; the ends hold for any time in (from, until].*/
+    };
+
+    /** What a macro lane shares with its neighbours when stepping by dataflow.
+     *  Time in simulator::macro_flow counts substeps: substep s of step k is
+     *  at k*(S+1) + s for S = 2^macro_max_level substeps a step, and the
+     *  step's reflux is at k*(S+1) + S. A lane takes its action at time t
+     *  once every neighbour is ready(t), then publishes its new ends to the
+     *  slot no neighbour can be reading. Neighbours wait on each other, so
+     *  none gets more than one publication ahead and two slots are enough.
+     */
+    struct lane_flow
+    {
+        lane_flow() : count(0), nbr_begin(0), nbr_end(0) {}
+
+        /** Start over at time 0 with the lane's current ends.
+         */
+        void seed(const lane &l);
+
+        /** Publish the lane's ends after its action at from.
+         */
+        void publish(const lane &l, int64_t from, int64_t until);
+
+        /** Whether every action of the lane before time t is published.
+         */
+        bool ready(const int64_t t) const
+        {
+            return ends[count.load(std::memory_order_acquire) % 2].until >= t;
+        }
+
+        /** The ends a collect at time t sees; only valid once ready(t).
+         */
+        const lane_ends &at(const int64_t t) const
+        {
+            const unsigned   c      = count.load(std::memory_order_acquire);
+            const lane_ends &latest = ends[c % 2];
+            return latest.from < t ? latest : ends[(c + 1) % 2];
+        }
+
+        std::atomic<unsigned> count;     /**< Publications so far; the latest is in ends[count % 2].*/
+        lane_ends             ends[2];
+        size_t                nbr_begin; /**< The lane's neighbours are simulator::flow_nbrs[nbr_begin, nbr_end).*/
+        size_t                nbr_end;
+        char                  pad[64];   // neighbours poll count; keep it off of each other's lines
     };
 
     struct roadblock
@@ -214,8 +467,6 @@ namespace hybrid
 
     struct simulator
     {
-        typedef boost::rand48  base_generator_type;
-
         struct serial_state
         {
             serial_state();
@@ -224,8 +475,7 @@ namespace hybrid
 
             void apply(simulator &s) const;
 
-            size_t               car_id_counter;
-            base_generator_type  generator;
+            size_t               step;
 
             hwm::network::serial_state        network_state;
             std::vector<lane::serial_state>   lane_states;
@@ -240,8 +490,20 @@ namespace hybrid
         float rear_bumper_offset()  const;
         float front_bumper_offset() const;
         void  car_swap();
+        void  car_swap(size_t thr_id);
+
+        car   make_car(lane &origin, const float position, const float velocity, const float acceleration);
+
+        typedef rand_stream rand_gen_t;
+        rand_gen_t rng(const lane &l, rng_purpose_t purpose) const;
+        rand_gen_t rng(const lane &l, rng_purpose_t purpose, size_t at_step) const;
+        rand_gen_t rng(const lane &l, rng_purpose_t purpose, size_t at_step, int substep) const;
+        size_t     lane_index(const lane &l) const;
 
-        car   make_car(const float position, const float velocity, const float acceleration);
+        void             build_links();
+        const lane_link &link(const lane &l) const { return links[lane_index(l)]; }
+        lane            *lane_at(const int i)       { return i < 0 ? 0 : &lanes[i]; }
+        const lane      *lane_at(const int i) const { return i < 0 ? 0 : &lanes[i]; }
 
         lane       &get_lane_by_name(const str &s);
         const lane &get_lane_by_name(const str &s) const;
@@ -255,38 +517,55 @@ namespace hybrid
         void convert_to_macro(lane &l);
 
         void parallel_hybrid_run(int nsteps);
+        void set_topology(const std::vector<int> &cpu_map, bool realtime=true);
         void advance_intersections(float dt);
         void apply_incoming_bc(float dt, float t);
+        void apply_incoming_bc(size_t thr_id, float dt, float t);
+        void apply_incoming_bc(size_t thr_id, sim_t sim_mask, float dt, float t, size_t at_step);
+        void apply_incoming_bc(lane &l, float dt, float rate, size_t at_step);
 
         serial_state serial() const;
         car_interp::car_hash get_car_hash() const;
 
         hwm::network          *hnet;
         std::vector<lane>      lanes;
+        std::vector<lane_link> links;
         std::vector<lane*>     micro_lanes;
         std::vector<lane*>     macro_lanes;
         std::vector<roadblock> roadblocks;
 
         std::vector<worker>    workers;
+        thread_pool           *pool;
 
         float                  car_length;
         float                  rear_bumper_rear_axle;
         float                  time;
-        base_generator_type   *generator;
-        boost::uniform_real<> *uni_dist;
-        typedef boost::variate_generator<base_generator_type&,
-            boost::uniform_real<> > rand_gen_t;
-        rand_gen_t            *uni;
-        size_t                 car_id_counter;
+        uint64_t               seed;
+        size_t                 step;
 
         // micro
         void  micro_initialize(const float a_max, const float a_pref, const float v_pref,
                                const float delta);
         void  micro_cleanup();
         void  settle(const float timestep);
-        float acceleration(const float leader_velocity, const float follower_velocity, const float distance) const;
-        void  compute_accelerations(float timestep);
+        float acceleration(const float leader_velocity, const float follower_velocity, const float distance) const
+        {
+            return model(leader_velocity, follower_velocity, distance);
+        }
         void  update(float timestep);
+        void  micro_update(size_t thr_id, float timestep);
+        void  micro_partition();
+        void  micro_accelerations(size_t thr_id, float timestep);
+        void  micro_merges(size_t thr_id, float timestep);
+        void  micro_swap(size_t thr_id);
+        void  micro_integrate(size_t thr_id, float timestep);
+        void  micro_deliver(size_t thr_id);
+        void  transfer_cars(lane &l, worker &out);
+        void  apply_injections();
+        void  build_lookahead();
+
+        bool  lookahead_ready;
+        std::vector<lane*> lookahead_lanes; // lanes the last build_lookahead marked, to unmark in the next
         float micro_length() const;
         void  apply_roadblocks();
         void  clear_all_roadblocks();
@@ -296,16 +575,98 @@ namespace hybrid
         float v_pref;
         float delta;
 
+        car_following_t     model;
+        std::vector<size_t> micro_blocks;
+
         // macro
         void  macro_initialize(float h_suggest, float relaxation);
         void  macro_cleanup();
         void  convert_cars(sim_t sim_mask);
+        void  convert_cars(size_t thr_id, sim_t sim_mask);
         float macro_step(const float cfl=1.0f);
+        void  macro_exchange(size_t thr_id);
+        float macro_collect(size_t thr_id);
+        float macro_rate() const;
+        float macro_dt(float cfl, float max_dt) const;
+        float macro_dt(float rate, float cfl, float max_dt) const;
+        int   macro_level(float rate, float dt, float cfl) const;
+        void  build_flows();
+        float macro_flow_prepare(float cfl, float max_dt);
+        void  macro_flow_seed(size_t thr_id);
+        bool  macro_flow_act(lane &l, float dt, size_t &overruns);
+        size_t macro_flow_overruns();
+        void  macro_flow(size_t thr_id, float dt, int nsteps);
+        float macro_flow_run(int nsteps, float cfl=1.0f, float max_dt=0.5f);
+        int   macro_substeps(float dt, float cfl) const;
+        void  macro_begin_update(size_t thr_id, float dt, float cfl);
+        void  macro_substep_collect(size_t thr_id, int s, int substeps);
+        void  macro_substep_update(size_t thr_id, float dt, int s, int substeps);
+        void  macro_reflux(size_t thr_id);
+        void  macro_update(size_t thr_id, float dt, float cfl);
+        void  macro_lagged_rates(int slot, float &rate, float &courant) const;
+        void  macro_lagged_send(size_t thr_id, int parity);
+        void  macro_lagged_begin(size_t thr_id, float dt, float cfl, int slot);
+        void  macro_lagged_substep(size_t thr_id, float dt, int s, int substeps, int parity, int slot);
+        void  macro_lagged_restore(size_t thr_id, int parity);
+        float macro_lagged_run(int nsteps, float cfl=1.0f, float max_dt=0.5f);
+        arz<float>::q fixed_ghost(lane &l, bool upstream, int t);
+        void  macro_fixed_begin(size_t thr_id);
+        void  macro_fixed_ends(size_t thr_id, int t, int steps, float dt);
+        void  macro_fixed_advance(size_t thr_id, int steps, float dt);
+        void  macro_fixed_run(int nsteps, float dt);
+        void  rebalance(bool force=false);
+        bool  plan_rebalance(bool force);
+        long  partition_lanes(const std::vector<lane*> &ls, bool by_activity, int nparts, std::vector<int> &part) const;
+        void  relayout(size_t thr_id);
+        bool  remesh();
         float macro_length() const;
 
         float                         h_suggest;
         float                         min_h;
+        cell_sizing                   sizing;
+        size_t                        remesh_step;
         float                         relaxation_factor;
+        int                           macro_max_level; // opt-in local time stepping; dt grows with it, and micro lanes take that dt too
         float                        *maxes;
+        bool                          rebalance_dirty;
+        float                         rebalance_threshold;
+        bool                          graph_partition;     // assign lanes to workers with partition() rather than by load alone
+        float                         partition_imbalance; // how far over the average a worker's cells may go with graph_partition
+        bool                          huge_pages; // ask for transparent huge pages for worker storage
+        bool                          numa_bind;  // explicitly bind worker storage to its thread's node
+        bool                          macro_dataflow; // parallel_hybrid_run steps macro lanes with macro_flow
+
+        // macro_lagged_run; dt from the previous step's rates, times cfl_safety
+        float                         cfl_safety;
+        size_t                        cfl_rollbacks; // lagged steps redone with a smaller dt
+        int                           lagged_attempt; // steps tried so far; picks the slots of maxes they use, -1 before the first
+
+        // macro_fixed_run; steps taken per pass over a lane's cells, cells per tile of a pass,
+        // and each lane's two end cells at every step of the pass, by lane index
+        int                           fixed_block;
+        size_t                        fixed_tile;
+        std::vector<arz<float>::q>    fixed_ends;
+
+        // macro_flow; neighbour lists, and dt from rate bounds, redone when flows_dirty
+        lane_flow                    *flows;
+        std::vector<int>              flow_nbrs;
+        bool                          flows_dirty;
+        float                         flow_dt;
+        float                         flow_cfl;
+        float                         flow_max_dt;
+
+        // plan_rebalance runs on one thread; then every thread moves its own worker in relayout
+        struct lane_stash
+        {
+            lane_stash(lane *in_l, const size_t in_offset, const size_t in_n) : l(in_l), offset(in_offset), n(in_n) {}
+
+            lane   *l;
+            size_t  offset; // where the lane's cells start in stash
+            size_t  n;      // how many there were
+        };
+
+        std::vector<arz<float>::q>             stash;
+        std::vector<std::vector<lane_stash> >  relayout_plan;
+        bool                                   relayout_pending;
     };
 }
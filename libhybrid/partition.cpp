@@ -0,0 +1,394 @@
+#include "libhybrid/partition.hpp"
+#include <algorithm>
+#include <queue>
+#include <cassert>
+
+namespace hybrid
+{
+    static const size_t COARSEST_PER_PART = 16; /**< Coarsening stops at about this many vertices a part. */
+    static const int    REFINE_PASSES     = 8;  /**< Most passes of refinement over a level. */
+
+    void partition_graph::build(const std::vector<std::pair<int, int> > &edges)
+    {
+        const int n = static_cast<int>(nvertices());
+
+        // both directions of every pair, by row
+        std::vector<size_t> start(n + 1, 0);
+        for(size_t i = 0; i < edges.size(); ++i)
+        {
+            const int a = edges[i].first;
+            const int b = edges[i].second;
+            if(a < 0 || b < 0 || a >= n || b >= n || a == b)
+                continue;
+            ++start[a + 1];
+            ++start[b + 1];
+        }
+        for(int v = 0; v < n; ++v)
+            start[v + 1] += start[v];
+
+        std::vector<int>    nbr(start[n]);
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for(size_t i = 0; i < edges.size(); ++i)
+        {
+            const int a = edges[i].first;
+            const int b = edges[i].second;
+            if(a < 0 || b < 0 || a >= n || b >= n || a == b)
+                continue;
+            nbr[fill[a]++] = b;
+            nbr[fill[b]++] = a;
+        }
+
+        // repeats of a pair become one heavier edge
+        xadj.assign(1, 0);
+        adjncy.clear();
+        adjwgt.clear();
+        for(int v = 0; v < n; ++v)
+        {
+            std::sort(nbr.begin() + start[v], nbr.begin() + start[v + 1]);
+            for(size_t j = start[v]; j < start[v + 1]; ++j)
+            {
+                if(j > start[v] && nbr[j] == nbr[j - 1])
+                    ++adjwgt.back();
+                else
+                {
+                    adjncy.push_back(nbr[j]);
+                    adjwgt.push_back(1);
+                }
+            }
+            xadj.push_back(adjncy.size());
+        }
+    }
+
+    long edge_cut(const partition_graph &g, const std::vector<int> &part)
+    {
+        long cut = 0;
+        for(size_t v = 0; v < g.nvertices(); ++v)
+        {
+            for(size_t j = g.xadj[v]; j < g.xadj[v + 1]; ++j)
+            {
+                if(part[g.adjncy[j]] != part[v])
+                    cut += g.adjwgt[j];
+            }
+        }
+        return cut/2;
+    }
+
+    // pair each vertex with the unpaired neighbour it has the heaviest edge to, and merge the pairs;
+    // cmap[v] is v's vertex in c
+    static void coarsen(const partition_graph &g, const long max_vwgt, partition_graph &c, std::vector<int> &cmap)
+    {
+        const size_t n = g.nvertices();
+
+        // vertices with few neighbours pick first, so they aren't left without a partner
+        size_t most = 0;
+        for(size_t v = 0; v < n; ++v)
+            most = std::max(most, g.xadj[v + 1] - g.xadj[v]);
+
+        std::vector<size_t> bucket(most + 2, 0);
+        for(size_t v = 0; v < n; ++v)
+            ++bucket[g.xadj[v + 1] - g.xadj[v] + 1];
+        for(size_t d = 0; d <= most; ++d)
+            bucket[d + 1] += bucket[d];
+
+        std::vector<int> order(n);
+        for(size_t v = 0; v < n; ++v)
+            order[bucket[g.xadj[v + 1] - g.xadj[v]]++] = static_cast<int>(v);
+
+        std::vector<int> match(n, -1);
+        for(size_t i = 0; i < n; ++i)
+        {
+            const int u = order[i];
+            if(match[u] >= 0)
+                continue;
+
+            int  best   = u;
+            long best_w = 0;
+            for(size_t j = g.xadj[u]; j < g.xadj[u + 1]; ++j)
+            {
+                const int v = g.adjncy[j];
+                if(match[v] < 0 && g.adjwgt[j] > best_w && g.vwgt[u] + g.vwgt[v] <= max_vwgt)
+                {
+                    best   = v;
+                    best_w = g.adjwgt[j];
+                }
+            }
+            match[u]    = best;
+            match[best] = u;
+        }
+
+        // a pair is numbered when its first vertex comes up, so rows are built in order
+        cmap.assign(n, -1);
+        int cn = 0;
+        for(size_t u = 0; u < n; ++u)
+        {
+            if(cmap[u] >= 0)
+                continue;
+            cmap[u]        = cn;
+            cmap[match[u]] = cn;
+            ++cn;
+        }
+
+        c.vwgt.assign(cn, 0);
+        for(size_t u = 0; u < n; ++u)
+            c.vwgt[cmap[u]] += g.vwgt[u];
+
+        std::vector<long> where(cn, -1); // where in c's edges the current row's edge to each coarse vertex is
+        c.xadj.assign(1, 0);
+        c.adjncy.clear();
+        c.adjwgt.clear();
+        for(size_t u = 0; u < n; ++u)
+        {
+            if(match[u] < static_cast<int>(u))
+                continue;
+
+            const int  cu        = cmap[u];
+            const long row_start = static_cast<long>(c.adjncy.size());
+            const int  members[2] = { static_cast<int>(u), match[u] };
+            for(int m = 0; m < (members[1] == members[0] ? 1 : 2); ++m)
+            {
+                const int f = members[m];
+                for(size_t j = g.xadj[f]; j < g.xadj[f + 1]; ++j)
+                {
+                    const int cv = cmap[g.adjncy[j]];
+                    if(cv == cu)
+                        continue;
+                    if(where[cv] >= row_start)
+                        c.adjwgt[where[cv]] += g.adjwgt[j];
+                    else
+                    {
+                        where[cv] = static_cast<long>(c.adjncy.size());
+                        c.adjncy.push_back(cv);
+                        c.adjwgt.push_back(g.adjwgt[j]);
+                    }
+                }
+            }
+            c.xadj.push_back(c.adjncy.size());
+        }
+    }
+
+    // grow the parts one at a time from a seed, taking the vertex most connected to the part next
+    static void grow(const partition_graph &g, const int nparts, std::vector<int> &part)
+    {
+        const size_t n = g.nvertices();
+
+        long total = 0;
+        for(size_t v = 0; v < n; ++v)
+            total += g.vwgt[v];
+
+        // breadth-first order over every piece of the graph; parts start from the first vertex left in it
+        std::vector<int>  bfs;
+        std::vector<char> seen(n, 0);
+        bfs.reserve(n);
+        for(size_t s = 0; s < n; ++s)
+        {
+            if(seen[s])
+                continue;
+            seen[s] = 1;
+            bfs.push_back(static_cast<int>(s));
+            for(size_t i = bfs.size() - 1; i < bfs.size(); ++i)
+            {
+                const int v = bfs[i];
+                for(size_t j = g.xadj[v]; j < g.xadj[v + 1]; ++j)
+                {
+                    if(!seen[g.adjncy[j]])
+                    {
+                        seen[g.adjncy[j]] = 1;
+                        bfs.push_back(g.adjncy[j]);
+                    }
+                }
+            }
+        }
+
+        part.assign(n, -1);
+        std::vector<long> conn(n, 0);
+        std::vector<int>  touched;
+        size_t            next_seed = 0;
+        long              assigned  = 0;
+        for(int p = 0; p < nparts - 1; ++p)
+        {
+            // what's left is spread over the parts that are left
+            const long target = (total - assigned)/(nparts - p);
+            long       weight = 0;
+
+            std::priority_queue<std::pair<long, int> > frontier;
+            while(weight < target)
+            {
+                int v = -1;
+                while(!frontier.empty())
+                {
+                    const std::pair<long, int> top = frontier.top();
+                    frontier.pop();
+                    if(part[top.second] < 0 && top.first == conn[top.second])
+                    {
+                        v = top.second;
+                        break;
+                    }
+                }
+                if(v < 0)
+                {
+                    while(next_seed < n && part[bfs[next_seed]] >= 0)
+                        ++next_seed;
+                    if(next_seed == n)
+                        break;
+                    v = bfs[next_seed];
+                }
+
+                // stop short rather than go further over than under
+                if(weight > 0 && weight + g.vwgt[v] - target > target - weight)
+                    break;
+
+                part[v]  = p;
+                weight  += g.vwgt[v];
+                for(size_t j = g.xadj[v]; j < g.xadj[v + 1]; ++j)
+                {
+                    const int u = g.adjncy[j];
+                    if(part[u] >= 0)
+                        continue;
+                    if(!conn[u])
+                        touched.push_back(u);
+                    conn[u] += g.adjwgt[j];
+                    frontier.push(std::make_pair(conn[u], u));
+                }
+            }
+
+            for(size_t i = 0; i < touched.size(); ++i)
+                conn[touched[i]] = 0;
+            touched.clear();
+            assigned += weight;
+        }
+
+        for(size_t v = 0; v < n; ++v)
+        {
+            if(part[v] < 0)
+                part[v] = nparts - 1;
+        }
+    }
+
+    // move each boundary vertex to the neighbouring part it's most connected to, if that cuts less and fits;
+    // a vertex of a part over limit moves even if it cuts more, and ties go to the lighter side
+    static void refine(const partition_graph &g, const int nparts, const long limit, std::vector<int> &part)
+    {
+        const size_t n = g.nvertices();
+
+        std::vector<long> weight(nparts, 0);
+        for(size_t v = 0; v < n; ++v)
+            weight[part[v]] += g.vwgt[v];
+
+        std::vector<long> conn(nparts, 0);
+        std::vector<int>  touched;
+        for(int pass = 0; pass < REFINE_PASSES; ++pass)
+        {
+            size_t moved = 0;
+            for(size_t v = 0; v < n; ++v)
+            {
+                const int  from = part[v];
+                const long w    = g.vwgt[v];
+                const bool over = weight[from] > limit;
+
+                for(size_t j = g.xadj[v]; j < g.xadj[v + 1]; ++j)
+                {
+                    const int q = part[g.adjncy[j]];
+                    if(!conn[q])
+                        touched.push_back(q);
+                    conn[q] += g.adjwgt[j];
+                }
+
+                const long internal  = conn[from];
+                int        to        = from;
+                long       best_gain = 0;
+                for(size_t i = 0; i < touched.size(); ++i)
+                {
+                    const int q = touched[i];
+                    if(q == from || weight[q] + w > limit)
+                        continue;
+
+                    const long gain = conn[q] - internal;
+                    if(to == from ? (gain > 0 || over || (gain == 0 && weight[q] + w < weight[from]))
+                                  : (gain > best_gain || (gain == best_gain && weight[q] < weight[to])))
+                    {
+                        to        = q;
+                        best_gain = gain;
+                    }
+                }
+
+                if(to == from && over)
+                {
+                    const int lightest = static_cast<int>(std::min_element(weight.begin(), weight.end()) - weight.begin());
+                    if(lightest != from && weight[lightest] + w <= limit)
+                        to = lightest;
+                }
+
+                for(size_t i = 0; i < touched.size(); ++i)
+                    conn[touched[i]] = 0;
+                touched.clear();
+
+                if(to != from)
+                {
+                    part[v]       = to;
+                    weight[from] -= w;
+                    weight[to]   += w;
+                    ++moved;
+                }
+            }
+
+            if(!moved)
+                break;
+        }
+    }
+
+    long partition(const partition_graph &g, const int nparts, const float imbalance, std::vector<int> &part)
+    {
+        const size_t n = g.nvertices();
+        part.assign(n, 0);
+        if(nparts <= 1 || n == 0)
+            return 0;
+
+        long total    = 0;
+        long heaviest = 0;
+        for(size_t v = 0; v < n; ++v)
+        {
+            total    += g.vwgt[v];
+            heaviest  = std::max(heaviest, g.vwgt[v]);
+        }
+
+        // a vertex heavier than the limit would fit nowhere, so the limit is at least that
+        const long average = (total + nparts - 1)/nparts;
+        const long limit   = std::max(static_cast<long>((1.0f + imbalance)*average), heaviest);
+
+        // merged vertices stay well under a part's weight, so the coarse parts can still be balanced
+        const size_t coarsest = COARSEST_PER_PART*nparts;
+        const long   max_vwgt = std::max(heaviest, static_cast<long>(1.5*total/coarsest));
+
+        std::vector<partition_graph>   coarse;
+        std::vector<std::vector<int> > cmaps;
+        while((coarse.empty() ? g : coarse.back()).nvertices() > coarsest)
+        {
+            coarse.push_back(partition_graph());
+            cmaps.push_back(std::vector<int>());
+
+            const partition_graph &fine = coarse.size() == 1 ? g : coarse[coarse.size() - 2];
+            coarsen(fine, max_vwgt, coarse.back(), cmaps.back());
+
+            // little left to pair: stars, or vertices already at max_vwgt
+            if(coarse.back().nvertices() > 0.95*fine.nvertices())
+                break;
+        }
+
+        std::vector<int> level_part;
+        grow(coarse.empty() ? g : coarse.back(), nparts, level_part);
+        for(size_t l = coarse.size(); l > 0; --l)
+        {
+            refine(coarse[l - 1], nparts, limit, level_part);
+
+            const std::vector<int> &cmap = cmaps[l - 1];
+            std::vector<int>        projected(cmap.size());
+            for(size_t v = 0; v < cmap.size(); ++v)
+                projected[v] = level_part[cmap[v]];
+            level_part.swap(projected);
+        }
+        refine(g, nparts, limit, level_part);
+
+        part.swap(level_part);
+        return edge_cut(g, part);
+    }
+}
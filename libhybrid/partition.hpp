@@ -0,0 +1,50 @@
+#ifndef __PARTITION_HPP__
+#define __PARTITION_HPP__
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace hybrid
+{
+    /** An undirected graph with weighted vertices and edges, in compressed sparse row form.
+     *  The neighbours of vertex v are adjncy[xadj[v], xadj[v+1]), with the
+     *  weight of each edge in adjwgt; every edge is listed from both ends.
+     */
+    struct partition_graph
+    {
+        size_t nvertices() const { return vwgt.size(); }
+
+        /** Fill in the edges from a list of vertex pairs; vwgt must already be set.
+         *  Pairs may come in either order and more than once, each time adding 1 to
+         *  the edge's weight. Pairs with an end out of range, or both ends the same,
+         *  are left out.
+         */
+        void build(const std::vector<std::pair<int, int> > &edges);
+
+        std::vector<size_t> xadj;
+        std::vector<int>    adjncy;
+        std::vector<long>   adjwgt;
+        std::vector<long>   vwgt;
+    };
+
+    /** Split a graph into nparts parts of about equal vertex weight, cutting as little edge weight as it can.
+     *  Multilevel, after Karypis and Kumar: vertices are paired along their heaviest
+     *  edges until the graph is a few vertices per part, the small graph is grown
+     *  into parts, and on the way back up each level's boundary vertices are moved
+     *  to whichever neighbouring part lowers the cut without breaking the balance.
+     *  Time is about linear in the number of edges. The result only depends on
+     *  the graph, so every process of a run can compute it for itself.
+     *  \param g The graph.
+     *  \param nparts How many parts; threads, processes, or both.
+     *  \param imbalance How far over the average weight a part may go, as a fraction of the average.
+     *  \param part On return, the part of each vertex, in [0, nparts).
+     *  \returns The weight of the edges between parts.
+     */
+    long partition(const partition_graph &g, int nparts, float imbalance, std::vector<int> &part);
+
+    /** The weight of the edges whose ends are in different parts.
+     */
+    long edge_cut(const partition_graph &g, const std::vector<int> &part);
+}
+#endif
@@ -0,0 +1,98 @@
+#ifndef _PHILOX_HPP_
+#define _PHILOX_HPP_
+
+#include <stdint.h>
+
+namespace hybrid
+{
+    /** The Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+     *  A keyed bijection from a 128-bit counter to 128 random bits: no state
+     *  is carried between calls, so any number of threads can draw from
+     *  disjoint counters without sharing anything.
+     */
+    struct philox4x32
+    {
+        /** Compute the 10-round block for ctr under key.
+         *  \param out The four resulting words.
+         *  \param ctr The counter.
+         *  \param key The key.
+         */
+        static void block(uint32_t out[4], const uint32_t ctr[4], const uint32_t key[2])
+        {
+            static const uint32_t M0 = 0xD2511F53u;
+            static const uint32_t M1 = 0xCD9E8D57u;
+            static const uint32_t W0 = 0x9E3779B9u;
+            static const uint32_t W1 = 0xBB67AE85u;
+
+            uint32_t c[4] = { ctr[0], ctr[1], ctr[2], ctr[3] };
+            uint32_t k[2] = { key[0], key[1] };
+            for(int r = 0; r < 10; ++r)
+            {
+                if(r > 0)
+                {
+                    k[0] += W0;
+                    k[1] += W1;
+                }
+
+                const uint64_t p0 = static_cast<uint64_t>(M0)*c[0];
+                const uint64_t p1 = static_cast<uint64_t>(M1)*c[2];
+                const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k[0];
+                const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k[1];
+                c[0] = n0;
+                c[1] = static_cast<uint32_t>(p1);
+                c[2] = n2;
+                c[3] = static_cast<uint32_t>(p0);
+            }
+
+            out[0] = c[0];
+            out[1] = c[1];
+            out[2] = c[2];
+            out[3] = c[3];
+        }
+    };
+
+    /** A stream of uniform variates in (0, 1) identified by (seed, lane, step, purpose).
+     *  The same four values always give the same sequence, whatever thread
+     *  draws it and whatever else was drawn before. Each call consumes 64
+     *  bits of a Philox block; 0 is never returned, so -log(u) is finite.
+     */
+    struct rand_stream
+    {
+        rand_stream() : used(4)
+        {
+            key[0] = key[1] = 0;
+            ctr[0] = ctr[1] = ctr[2] = ctr[3] = 0;
+        }
+
+        rand_stream(const uint64_t seed, const uint32_t lane, const uint32_t step, const uint32_t purpose) : used(4)
+        {
+            key[0] = static_cast<uint32_t>(seed);
+            key[1] = static_cast<uint32_t>(seed >> 32);
+            ctr[0] = 0;
+            ctr[1] = step;
+            ctr[2] = lane;
+            ctr[3] = purpose;
+        }
+
+        double operator()()
+        {
+            if(used == 4)
+            {
+                philox4x32::block(buf, ctr, key);
+                ++ctr[0];
+                used = 0;
+            }
+
+            // 53 bits; offset by half an ulp to stay off of 0
+            const uint64_t bits = (static_cast<uint64_t>(buf[used] >> 5) << 26) | (buf[used+1] >> 6);
+            used += 2;
+            return (static_cast<double>(bits) + 0.5)*(1.0/9007199254740992.0);
+        }
+
+        uint32_t key[2];
+        uint32_t ctr[4];
+        uint32_t buf[4];
+        int      used;
+    };
+}
+#endif
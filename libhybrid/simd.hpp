@@ -0,0 +1,222 @@
+#ifndef _SIMD_HPP_
+#define _SIMD_HPP_
+
+/** Thin wrappers over the x86 vector extensions used by the macro kernels.
+ *  simd::vfloat is the widest float vector the compiler may use (AVX-512, AVX
+ *  or SSE2); simd::sfloat is a one-wide stand-in with the same interface, used
+ *  for loop remainders and on targets without any of the above.
+ *  Kernels are written once as templates over either type.
+ */
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define SIMD_AVX512
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE
+#endif
+
+#include <cmath>
+#include <algorithm>
+
+namespace simd
+{
+    struct smask
+    {
+        smask() {}
+        smask(const bool in_m) : m(in_m) {}
+
+        bool m;
+    };
+
+    struct sfloat
+    {
+        typedef smask mask_t;
+        enum { width = 1 };
+
+        sfloat() {}
+        sfloat(const float in_v) : v(in_v) {}
+
+        static sfloat load(const float *p) { return sfloat(*p); }
+        void          store(float *p) const { *p = v; }
+        float         hmax() const { return v; }
+
+        float v;
+    };
+
+    inline smask  operator&(const smask &a, const smask &b)   { return a.m && b.m; }
+    inline smask  operator|(const smask &a, const smask &b)   { return a.m || b.m; }
+    inline smask  operator!(const smask &a)                   { return !a.m; }
+    inline bool   any      (const smask &a)                   { return a.m; }
+
+    inline sfloat operator+(const sfloat &a, const sfloat &b) { return a.v + b.v; }
+    inline sfloat operator-(const sfloat &a, const sfloat &b) { return a.v - b.v; }
+    inline sfloat operator*(const sfloat &a, const sfloat &b) { return a.v * b.v; }
+    inline sfloat operator/(const sfloat &a, const sfloat &b) { return a.v / b.v; }
+    inline sfloat operator-(const sfloat &a)                  { return -a.v; }
+    inline smask  operator<(const sfloat &a, const sfloat &b) { return a.v <  b.v; }
+    inline smask  operator<=(const sfloat &a, const sfloat &b){ return a.v <= b.v; }
+    inline smask  operator>(const sfloat &a, const sfloat &b) { return a.v >  b.v; }
+    inline smask  operator>=(const sfloat &a, const sfloat &b){ return a.v >= b.v; }
+    inline sfloat min (const sfloat &a, const sfloat &b)      { return std::min(a.v, b.v); }
+    inline sfloat max (const sfloat &a, const sfloat &b)      { return std::max(a.v, b.v); }
+    inline sfloat abs (const sfloat &a)                       { return std::abs(a.v); }
+    inline sfloat sqrt(const sfloat &a)                       { return std::sqrt(a.v); }
+    inline sfloat select(const smask &m, const sfloat &a, const sfloat &b) { return m.m ? a.v : b.v; }
+
+#if defined(SIMD_AVX512)
+    struct vmask
+    {
+        vmask() {}
+        vmask(const __mmask16 in_m) : m(in_m) {}
+
+        __mmask16 m;
+    };
+
+    struct vfloat
+    {
+        typedef vmask mask_t;
+        enum { width = 16 };
+
+        vfloat() {}
+        vfloat(const __m512 in_v) : v(in_v) {}
+        vfloat(const float s)     : v(_mm512_set1_ps(s)) {}
+
+        static vfloat load(const float *p) { return _mm512_loadu_ps(p); }
+        void          store(float *p) const { _mm512_storeu_ps(p, v); }
+        float         hmax() const { return _mm512_reduce_max_ps(v); }
+
+        __m512 v;
+    };
+
+    inline vmask  operator&(const vmask &a, const vmask &b)   { return static_cast<__mmask16>(a.m & b.m); }
+    inline vmask  operator|(const vmask &a, const vmask &b)   { return static_cast<__mmask16>(a.m | b.m); }
+    inline vmask  operator!(const vmask &a)                   { return static_cast<__mmask16>(~a.m); }
+    inline bool   any      (const vmask &a)                   { return a.m != 0; }
+
+    inline vfloat operator+(const vfloat &a, const vfloat &b) { return _mm512_add_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a, const vfloat &b) { return _mm512_sub_ps(a.v, b.v); }
+    inline vfloat operator*(const vfloat &a, const vfloat &b) { return _mm512_mul_ps(a.v, b.v); }
+    inline vfloat operator/(const vfloat &a, const vfloat &b) { return _mm512_div_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a)                  { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+    inline vmask  operator<(const vfloat &a, const vfloat &b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+    inline vmask  operator<=(const vfloat &a, const vfloat &b){ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+    inline vmask  operator>(const vfloat &a, const vfloat &b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+    inline vmask  operator>=(const vfloat &a, const vfloat &b){ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+    inline vfloat min (const vfloat &a, const vfloat &b)      { return _mm512_min_ps(a.v, b.v); }
+    inline vfloat max (const vfloat &a, const vfloat &b)      { return _mm512_max_ps(a.v, b.v); }
+    inline vfloat abs (const vfloat &a)                       { return _mm512_abs_ps(a.v); }
+    inline vfloat sqrt(const vfloat &a)                       { return _mm512_sqrt_ps(a.v); }
+    inline vfloat select(const vmask &m, const vfloat &a, const vfloat &b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+#elif defined(SIMD_AVX)
+    struct vmask
+    {
+        vmask() {}
+        vmask(const __m256 in_m) : m(in_m) {}
+
+        __m256 m;
+    };
+
+    struct vfloat
+    {
+        typedef vmask mask_t;
+        enum { width = 8 };
+
+        vfloat() {}
+        vfloat(const __m256 in_v) : v(in_v) {}
+        vfloat(const float s)     : v(_mm256_set1_ps(s)) {}
+
+        static vfloat load(const float *p) { return _mm256_loadu_ps(p); }
+        void          store(float *p) const { _mm256_storeu_ps(p, v); }
+        float         hmax() const
+        {
+            __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            m        = _mm_max_ps(m, _mm_movehl_ps(m, m));
+            m        = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+            return _mm_cvtss_f32(m);
+        }
+
+        __m256 v;
+    };
+
+    inline vmask  operator&(const vmask &a, const vmask &b)   { return _mm256_and_ps(a.m, b.m); }
+    inline vmask  operator|(const vmask &a, const vmask &b)   { return _mm256_or_ps(a.m, b.m); }
+    inline vmask  operator!(const vmask &a)                   { return _mm256_xor_ps(a.m, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    inline bool   any      (const vmask &a)                   { return _mm256_movemask_ps(a.m) != 0; }
+
+    inline vfloat operator+(const vfloat &a, const vfloat &b) { return _mm256_add_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a, const vfloat &b) { return _mm256_sub_ps(a.v, b.v); }
+    inline vfloat operator*(const vfloat &a, const vfloat &b) { return _mm256_mul_ps(a.v, b.v); }
+    inline vfloat operator/(const vfloat &a, const vfloat &b) { return _mm256_div_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a)                  { return _mm256_sub_ps(_mm256_setzero_ps(), a.v); }
+    inline vmask  operator<(const vfloat &a, const vfloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline vmask  operator<=(const vfloat &a, const vfloat &b){ return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    inline vmask  operator>(const vfloat &a, const vfloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline vmask  operator>=(const vfloat &a, const vfloat &b){ return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline vfloat min (const vfloat &a, const vfloat &b)      { return _mm256_min_ps(a.v, b.v); }
+    inline vfloat max (const vfloat &a, const vfloat &b)      { return _mm256_max_ps(a.v, b.v); }
+    inline vfloat abs (const vfloat &a)                       { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+    inline vfloat sqrt(const vfloat &a)                       { return _mm256_sqrt_ps(a.v); }
+    inline vfloat select(const vmask &m, const vfloat &a, const vfloat &b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+#elif defined(SIMD_SSE)
+    struct vmask
+    {
+        vmask() {}
+        vmask(const __m128 in_m) : m(in_m) {}
+
+        __m128 m;
+    };
+
+    struct vfloat
+    {
+        typedef vmask mask_t;
+        enum { width = 4 };
+
+        vfloat() {}
+        vfloat(const __m128 in_v) : v(in_v) {}
+        vfloat(const float s)     : v(_mm_set1_ps(s)) {}
+
+        static vfloat load(const float *p) { return _mm_loadu_ps(p); }
+        void          store(float *p) const { _mm_storeu_ps(p, v); }
+        float         hmax() const
+        {
+            __m128 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+            m        = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+            return _mm_cvtss_f32(m);
+        }
+
+        __m128 v;
+    };
+
+    inline vmask  operator&(const vmask &a, const vmask &b)   { return _mm_and_ps(a.m, b.m); }
+    inline vmask  operator|(const vmask &a, const vmask &b)   { return _mm_or_ps(a.m, b.m); }
+    inline vmask  operator!(const vmask &a)                   { return _mm_xor_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+    inline bool   any      (const vmask &a)                   { return _mm_movemask_ps(a.m) != 0; }
+
+    inline vfloat operator+(const vfloat &a, const vfloat &b) { return _mm_add_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a, const vfloat &b) { return _mm_sub_ps(a.v, b.v); }
+    inline vfloat operator*(const vfloat &a, const vfloat &b) { return _mm_mul_ps(a.v, b.v); }
+    inline vfloat operator/(const vfloat &a, const vfloat &b) { return _mm_div_ps(a.v, b.v); }
+    inline vfloat operator-(const vfloat &a)                  { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+    inline vmask  operator<(const vfloat &a, const vfloat &b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline vmask  operator<=(const vfloat &a, const vfloat &b){ return _mm_cmple_ps(a.v, b.v); }
+    inline vmask  operator>(const vfloat &a, const vfloat &b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline vmask  operator>=(const vfloat &a, const vfloat &b){ return _mm_cmpge_ps(a.v, b.v); }
+    inline vfloat min (const vfloat &a, const vfloat &b)      { return _mm_min_ps(a.v, b.v); }
+    inline vfloat max (const vfloat &a, const vfloat &b)      { return _mm_max_ps(a.v, b.v); }
+    inline vfloat abs (const vfloat &a)                       { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    inline vfloat sqrt(const vfloat &a)                       { return _mm_sqrt_ps(a.v); }
+    inline vfloat select(const vmask &m, const vfloat &a, const vfloat &b)
+    {
+        return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+    }
+#else
+    typedef smask  vmask;
+    typedef sfloat vfloat;
+#endif
+}
+
+#endif
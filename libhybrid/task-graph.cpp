@@ -0,0 +1,188 @@
+#include "libhybrid/task-graph.hpp"
+#include "libhybrid/timer.hpp"
+#include <thread>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define graph_pause() _mm_pause()
+#else
+#define graph_pause() ((void)0)
+#endif
+
+namespace hybrid
+{
+    static const int YIELD_EVERY = 1 << 10; /**< Fruitless scans of the graph before a thread yields its cpu. */
+
+    task_graph::node::node(phase &p, const size_t n, const bool o, const int s)
+        : work(&p), items(n), owned(o), slot(s), claimed(0), finished(0), done(0), skipped(0), item_done(new std::atomic<size_t>[n])
+    {
+        for(size_t i = 0; i < items; ++i)
+            item_done[i].store(0, std::memory_order_relaxed);
+    }
+
+    task_graph::node::~node()
+    {
+        delete[] item_done;
+    }
+
+    task_graph::task_graph(const size_t in_nthreads) : nthreads(in_nthreads), runs(in_nthreads, 0)
+    {
+    }
+
+    task_graph::~task_graph()
+    {
+        for(size_t i = 0; i < nodes.size(); ++i)
+            delete nodes[i];
+    }
+
+    size_t task_graph::add(phase &p, const size_t items, const bool owned, const int slot)
+    {
+        assert(items > 0);
+        assert(!owned || items <= nthreads);
+        nodes.push_back(new node(p, items, owned, slot));
+        return nodes.size() - 1;
+    }
+
+    void task_graph::after(const size_t p, const size_t before)
+    {
+        assert(before < p && p < nodes.size());
+        nodes[p]->deps.push_back(before);
+    }
+
+    void task_graph::after_item(const size_t p, const size_t before)
+    {
+        assert(before < p && p < nodes.size());
+        assert(nodes[p]->items == nodes[before]->items);
+        nodes[p]->item_deps.push_back(before);
+    }
+
+    bool task_graph::deps_done(const node &n, const size_t r) const
+    {
+        for(size_t i = 0; i < n.deps.size(); ++i)
+        {
+            if(nodes[n.deps[i]]->done.load(std::memory_order_acquire) < r)
+                return false;
+        }
+        return true;
+    }
+
+    bool task_graph::item_ready(const node &n, const size_t item, const size_t r) const
+    {
+        for(size_t i = 0; i < n.item_deps.size(); ++i)
+        {
+            if(nodes[n.item_deps[i]]->item_done[item].load(std::memory_order_acquire) < r)
+                return false;
+        }
+        return true;
+    }
+
+    void task_graph::retire(node &n, const size_t r)
+    {
+        assert(n.item_deps.empty());
+
+        // whoever gets here first retires it; the rest leave it alone
+        size_t last = n.skipped.load(std::memory_order_relaxed);
+        if(last >= r || !n.skipped.compare_exchange_strong(last, r, std::memory_order_acq_rel))
+            return;
+
+        n.claimed.fetch_add(n.owned ? 0 : n.items, std::memory_order_relaxed);
+        for(size_t i = 0; i < n.items; ++i)
+            n.item_done[i].store(r, std::memory_order_relaxed);
+        n.finished.fetch_add(n.items, std::memory_order_relaxed);
+        n.done.store(r, std::memory_order_release);
+    }
+
+    bool task_graph::claim(node &n, const size_t thr_id, const size_t r, size_t &item)
+    {
+        // nothing about a phase is decided before the phases it comes after are done
+        if(!deps_done(n, r))
+            return false;
+
+        if(!n.work->active())
+        {
+            retire(n, r);
+            return false;
+        }
+
+        if(n.owned)
+        {
+            item = thr_id;
+            return thr_id < n.items
+                && n.item_done[item].load(std::memory_order_relaxed) < r
+                && item_ready(n, item, r);
+        }
+
+        // items are handed out in order; the next one has to be ready before it's taken
+        size_t c = n.claimed.load(std::memory_order_relaxed);
+        while(c < r*n.items)
+        {
+            item = c - (r-1)*n.items;
+            if(!item_ready(n, item, r))
+                return false;
+            if(n.claimed.compare_exchange_weak(c, c + 1, std::memory_order_acq_rel))
+                return true;
+        }
+        return false;
+    }
+
+    void task_graph::execute(node &n, const size_t item, const size_t thr_id, const size_t r, double *busy)
+    {
+        if(busy && n.slot >= 0)
+        {
+            timer t;
+            t.reset();
+            t.start();
+            n.work->run(item, thr_id);
+            t.stop();
+            busy[n.slot] += t.interval_S();
+        }
+        else
+            n.work->run(item, thr_id);
+
+        n.item_done[item].store(r, std::memory_order_release);
+        if(n.finished.fetch_add(1, std::memory_order_acq_rel) + 1 == r*n.items)
+        {
+            n.work->finish();
+            n.done.store(r, std::memory_order_release);
+        }
+    }
+
+    void task_graph::run(const size_t thr_id, double *busy)
+    {
+        const size_t r     = ++runs[thr_id];
+        size_t       first = 0; // every phase before this one is done
+        int          idle  = 0;
+        while(first < nodes.size())
+        {
+            bool progress = false;
+            for(size_t p = first; p < nodes.size(); ++p)
+            {
+                node &n = *nodes[p];
+                if(n.done.load(std::memory_order_acquire) >= r)
+                {
+                    if(p == first)
+                        ++first;
+                    continue;
+                }
+
+                size_t item;
+                if(!claim(n, thr_id, r, item))
+                    continue;
+
+                execute(n, item, thr_id, r, busy);
+                progress = true;
+
+                // back to the front: earlier phases are the ones everything else waits on
+                break;
+            }
+
+            if(progress)
+                idle = 0;
+            else if(++idle % YIELD_EVERY == 0)
+                std::this_thread::yield();
+            else
+                graph_pause();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef __TASK_GRAPH_HPP__
+#define __TASK_GRAPH_HPP__
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+namespace hybrid
+{
+    /** A fixed dependency graph of phases that every thread of a thread_pool works through together.
+     *  A phase is a number of independent items. It becomes ready once the
+     *  phases it comes after are done; with after_item, item i only waits
+     *  for item i of the other phase. Threads take whatever item is ready
+     *  instead of meeting at barriers, so independent phases overlap and
+     *  a single-item phase keeps one thread busy while the rest go on.
+     *  Items of an owned phase only run on the thread of the same index,
+     *  for work on a worker's own storage. The graph is run any number of
+     *  times; a run starts once every thread is done with the previous one.
+     */
+    struct task_graph
+    {
+        /** The work of one phase.
+         */
+        struct phase
+        {
+            virtual ~phase() {}
+
+            /** Run one item.
+             *  \param item Index of the item in [0, items).
+             *  \param thr_id The thread running it.
+             */
+            virtual void run(size_t item, size_t thr_id) = 0;
+
+            /** Called once every item of a run is done, by the thread that finished the last one.
+             *  Phases that come after this one don't start until it returns.
+             */
+            virtual void finish() {}
+
+            /** Whether the phase has anything to do in this run.
+             *  Asked once the phases it comes after are done; if not, one
+             *  thread marks it done without running items or finish().
+             *  Phases with after_item dependencies must always be active.
+             */
+            virtual bool active() const { return true; }
+        };
+
+        /** An empty graph for a pool of nthreads threads.
+         */
+        explicit task_graph(size_t nthreads);
+        ~task_graph();
+
+        /** Add a phase; the phases it depends on must have been added first.
+         *  \param p The work, which the graph doesn't own.
+         *  \param items How many items it has; at least 1, at most nthreads if owned.
+         *  \param owned If true, item t only runs on thread t.
+         *  \param slot Where run() adds the time spent in its items; -1 for untimed.
+         *  \returns The index of the phase, for after() and after_item().
+         */
+        size_t add(phase &p, size_t items, bool owned, int slot=-1);
+
+        /** Phase p starts once all of phase before is done.
+         */
+        void after(size_t p, size_t before);
+
+        /** Item i of phase p starts once item i of phase before is done; both have the same number of items.
+         */
+        void after_item(size_t p, size_t before);
+
+        /** Work through one run of the graph and return once all of it is done.
+         *  Every thread of the pool calls this, the same number of times, from inside a job.
+         *  \param thr_id The calling thread.
+         *  \param busy If not 0, seconds spent in the items of each timed phase are added to busy[slot].
+         */
+        void run(size_t thr_id, double *busy=0);
+
+    private:
+        task_graph(const task_graph &);
+        task_graph &operator=(const task_graph &);
+
+        struct node
+        {
+            node(phase &p, size_t n, bool o, int s);
+            ~node();
+
+            phase                *work;
+            size_t                items;
+            bool                  owned;
+            int                   slot;
+            std::vector<size_t>   deps;      // phases all of which come first
+            std::vector<size_t>   item_deps; // phases whose item i comes before item i
+            std::atomic<size_t>   claimed;   // items taken over all runs so far
+            std::atomic<size_t>   finished;  // items done over all runs so far
+            std::atomic<size_t>   done;      // runs completed
+            std::atomic<size_t>   skipped;   // last run it was found inactive in
+            std::atomic<size_t>  *item_done; // runs completed by each item
+        };
+
+        bool deps_done(const node &n, size_t r) const;
+        bool item_ready(const node &n, size_t item, size_t r) const;
+        void retire(node &n, size_t r);
+        bool claim(node &n, size_t thr_id, size_t r, size_t &item);
+        void execute(node &n, size_t item, size_t thr_id, size_t r, double *busy);
+
+        size_t              nthreads;
+        std::vector<node*>  nodes;
+        std::vector<size_t> runs; // runs[t] is how many runs thread t has started
+    };
+}
+#endif
@@ -0,0 +1,192 @@
+#include "libhybrid/thread-pool.hpp"
+#include <iostream>
+#include <climits>
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#undef max
+#undef min
+#else
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define pool_pause() _mm_pause()
+#else
+#define pool_pause() ((void)0)
+#endif
+
+namespace hybrid
+{
+    static const int SPIN_COUNT = 1 << 14; /**< Spins before a waiting thread goes to sleep. */
+
+    // sleep until *addr != expected (spuriously waking is fine)
+    static inline void pool_wait(std::atomic<unsigned> &addr, const unsigned expected)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<unsigned*>(&addr), FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static inline void pool_wake(std::atomic<unsigned> &addr)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<unsigned*>(&addr), FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+#endif
+    }
+
+    // wait for addr to move off of expected; spin first, then sleep
+    static inline void wait_while_equal(std::atomic<unsigned> &addr, const unsigned expected, std::atomic<int> &sleepers, const int spin)
+    {
+        for(int i = 0; i < spin; ++i)
+        {
+            if(addr.load(std::memory_order_acquire) != expected)
+                return;
+            pool_pause();
+        }
+
+        while(addr.load(std::memory_order_acquire) == expected)
+        {
+            sleepers.fetch_add(1);
+            pool_wait(addr, expected);
+            sleepers.fetch_sub(1);
+        }
+    }
+
+    thread_pool::thread_pool(const size_t in_nthreads, const std::vector<int> &in_cpu_map, const bool in_realtime)
+        : nthreads(in_nthreads),
+          cpu_map(in_cpu_map),
+          realtime(in_realtime),
+          spin(SPIN_COUNT),
+          current(0),
+          stopping(false),
+          generation(0),
+          remaining(0),
+          bar_count(0),
+          bar_generation(0),
+          sleepers(0)
+    {
+        assert(nthreads > 0);
+        static_assert(sizeof(std::atomic<unsigned>) == sizeof(unsigned), "futex needs a plain 32-bit word");
+
+        if(cpu_map.empty())
+        {
+            const unsigned num_procs = std::max(1u, std::thread::hardware_concurrency());
+            for(size_t t = 0; t < nthreads; ++t)
+                cpu_map.push_back(t % num_procs);
+        }
+        assert(cpu_map.size() >= nthreads);
+
+        // threads sharing a cpu would spin against the one they wait on
+        std::vector<int> cpus(cpu_map.begin(), cpu_map.begin() + nthreads);
+        std::sort(cpus.begin(), cpus.end());
+        if(std::adjacent_find(cpus.begin(), cpus.end()) != cpus.end())
+            spin = 0;
+
+        pin(0);
+        for(size_t t = 1; t < nthreads; ++t)
+            threads.push_back(std::thread(&thread_pool::thread_main, this, t));
+    }
+
+    thread_pool::~thread_pool()
+    {
+        stopping = true;
+        generation.fetch_add(1);
+        pool_wake(generation);
+
+        for(size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+    }
+
+    void thread_pool::run(job &j)
+    {
+        current = &j;
+        remaining.store(nthreads - 1, std::memory_order_relaxed);
+        generation.fetch_add(1);
+        if(sleepers.load() > 0)
+            pool_wake(generation);
+
+        j(0, *this);
+
+        unsigned left;
+        while((left = remaining.load(std::memory_order_acquire)) != 0)
+            wait_while_equal(remaining, left, sleepers, spin);
+        current = 0;
+    }
+
+    void thread_pool::barrier(const size_t)
+    {
+        if(nthreads == 1)
+            return;
+
+        const unsigned gen = bar_generation.load(std::memory_order_acquire);
+        if(bar_count.fetch_add(1, std::memory_order_acq_rel) == nthreads - 1)
+        {
+            bar_count.store(0, std::memory_order_relaxed);
+            bar_generation.fetch_add(1);
+            if(sleepers.load() > 0)
+                pool_wake(bar_generation);
+        }
+        else
+            wait_while_equal(bar_generation, gen, sleepers, spin);
+    }
+
+    void thread_pool::thread_main(const size_t thr_id)
+    {
+        pin(thr_id);
+
+        unsigned seen = 0;
+        while(1)
+        {
+            wait_while_equal(generation, seen, sleepers, spin);
+            seen = generation.load(std::memory_order_acquire);
+            if(stopping)
+                break;
+
+            (*current)(thr_id, *this);
+
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 && sleepers.load() > 0)
+                pool_wake(remaining);
+        }
+    }
+
+    void thread_pool::pin(const size_t thr_id) const
+    {
+        const int cpu = cpu_map[thr_id];
+#ifdef _MSC_VER
+        DWORD_PTR mask = (static_cast<DWORD_PTR>(1) << cpu);
+        if(SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+            fprintf(stderr, "Couldn't set affinity for thread %d\n", static_cast<int>(thr_id));
+
+        if(realtime && SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) == 0)
+            fprintf(stderr, "Couldn't set realtime priority for thread %d\n", static_cast<int>(thr_id));
+#else
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+
+        if(sched_setaffinity(0, sizeof(mask), &mask) == -1)
+            std::cerr << "Couldn't set affinity for thread: " << thr_id << std::endl;
+
+        if(realtime)
+        {
+            struct sched_param sp;
+            sp.sched_priority = 10;
+            if(sched_setscheduler(0, SCHED_FIFO, &sp) != 0)
+                std::cerr << "Can't set SCHED_FIFO for thread: " << thr_id << std::endl;
+        }
+#endif
+    }
+}
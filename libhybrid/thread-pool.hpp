@@ -0,0 +1,78 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+namespace hybrid
+{
+    /** Fixed set of pinned threads that run jobs handed to them by one master.
+     *  Threads are created, pinned to their cpus and (optionally) given
+     *  real-time priority once, in the constructor. Handing over a job is a
+     *  store to a shared counter; idle threads spin on it for a while and
+     *  then sleep on a futex (Linux) or yield (elsewhere). If the map puts
+     *  two threads on one cpu they skip the spinning.
+     */
+    struct thread_pool
+    {
+        /** Work run by every thread of the pool.
+         */
+        struct job
+        {
+            virtual ~job() {}
+
+            /** Body of the job.
+             *  \param thr_id Index of the calling thread in [0, pool.size()).
+             *  \param pool The pool running the job, for barrier().
+             */
+            virtual void operator()(size_t thr_id, thread_pool &pool) = 0;
+        };
+
+        /** Start nthreads-1 threads; the thread calling run() acts as thread 0.
+         *  \param nthreads Total number of threads, including the master.
+         *  \param cpu_map cpu_map[t] is the cpu thread t is pinned to; if empty, t % number of cpus.
+         *  \param realtime Try to run the threads with SCHED_FIFO.
+         *  The calling thread is pinned to cpu_map[0] here.
+         */
+        thread_pool(size_t nthreads, const std::vector<int> &cpu_map=std::vector<int>(), bool realtime=true);
+        ~thread_pool();
+
+        /** Run j on every thread and return once all of them are done.
+         *  Only the master may call this, and not from inside a job.
+         */
+        void run(job &j);
+
+        /** Block until every thread of the pool has reached this barrier.
+         *  Only valid inside a job; every thread must call it the same number of times.
+         */
+        void barrier(size_t thr_id);
+
+        size_t size() const { return nthreads; }
+
+        const std::vector<int> &topology() const { return cpu_map; }
+
+    private:
+        thread_pool(const thread_pool &);
+        thread_pool &operator=(const thread_pool &);
+
+        void thread_main(size_t thr_id);
+        void pin(size_t thr_id) const;
+
+        size_t                   nthreads;
+        std::vector<int>         cpu_map;
+        bool                     realtime;
+        int                      spin;
+        std::vector<std::thread> threads;
+
+        job                     *current;
+        bool                     stopping;
+        std::atomic<unsigned>    generation;
+        std::atomic<unsigned>    remaining;
+        std::atomic<unsigned>    bar_count;
+        std::atomic<unsigned>    bar_generation;
+        std::atomic<int>         sleepers;
+    };
+}
+#endif
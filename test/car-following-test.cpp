@@ -0,0 +1,74 @@
+#include "libhybrid/car-following.hpp"
+#include "libhybrid/philox.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+// simulator::acceleration as it was, with the exponent and both powers at run time
+static float scan_acceleration(const hybrid::car_following_params &p, const float leader_velocity, const float follower_velocity, float distance)
+{
+    static const float s1 = 2;
+    static const float T  = 1.6;
+    const float EPSILON = 10e-7;
+
+    const float optimal_spacing = s1 + T*follower_velocity + (follower_velocity*(follower_velocity - leader_velocity))/2*(std::sqrt(p.a_max*p.a_pref));
+
+    if (distance > p.car_length)
+        distance -= p.car_length;
+    if (distance <= 0)
+        distance = EPSILON;
+
+    return p.a_max*(1 - std::pow((follower_velocity / p.v_pref), p.delta) - std::pow((optimal_spacing/(distance)), 2));
+}
+
+static bool close(const float a, const float b)
+{
+    return std::abs(a - b) <= 1e-4f*std::max(1.0f, std::abs(b));
+}
+
+// idm<4>, idm<0> and idm<4> given some other delta, one at a time and batched, against the old
+// formula; gaps from overlapping cars to free road, and n not a multiple of the vector width
+template <int DELTA>
+static bool idm_matches(const float delta)
+{
+    static const size_t N = 100003;
+
+    hybrid::car_following_params p;
+    p.a_max      = 0.73f;
+    p.a_pref     = 1.67f;
+    p.v_pref     = 33.0f;
+    p.delta      = delta;
+    p.car_length = 4.5f;
+    const hybrid::idm<DELTA> model(p);
+
+    hybrid::rand_stream r(42, DELTA, 0, 0);
+    std::vector<float>  leader_velocity(N), follower_velocity(N), distance(N), out(N);
+    for(size_t i = 0; i < N; ++i)
+    {
+        leader_velocity[i]   = static_cast<float>(40.0*r());
+        follower_velocity[i] = static_cast<float>(40.0*r());
+        distance[i]          = static_cast<float>(r() < 0.05 ? -p.car_length + 2.0*p.car_length*r() : 1000.0*r()*r());
+    }
+    hybrid::accelerations(model, &leader_velocity[0], &follower_velocity[0], &distance[0], &out[0], N);
+
+    bool ok = true;
+    for(size_t i = 0; i < N; ++i)
+    {
+        const float a = scan_acceleration(p, leader_velocity[i], follower_velocity[i], distance[i]);
+        ok = ok && close(model(leader_velocity[i], follower_velocity[i], distance[i]), a) && close(out[i], a);
+    }
+
+    std::cout << "idm<" << DELTA << "> with delta " << delta << ": " << N << " pairs" << (ok ? "" : " MISMATCH") << std::endl;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = idm_matches<4>(4.0f) && ok;
+    ok = idm_matches<0>(4.0f) && ok;
+    ok = idm_matches<4>(3.5f) && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
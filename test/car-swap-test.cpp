@@ -0,0 +1,103 @@
+#include "libhybrid/hybrid-sim.hpp"
+#include <iostream>
+#include <algorithm>
+
+struct position_less
+{
+    bool operator()(const hybrid::car &l, const hybrid::car &r) const
+    {
+        return l.position < r.position;
+    }
+};
+
+struct id_less
+{
+    bool operator()(const hybrid::car &l, const hybrid::car &r) const
+    {
+        return l.id < r.id;
+    }
+};
+
+// next_cars() the ways the micro step leaves it: in order, reversed, either with a few arrivals
+// and merges tacked on the end, shuffled outright, and with cars sharing a position
+static void make_next_cars(hybrid::lane &l, hybrid::rand_stream &r, const int shape, const size_t n)
+{
+    static hybrid::lane other;
+
+    std::vector<hybrid::car> &next = l.next_cars();
+    for(size_t i = 0; i < n; ++i)
+    {
+        const float position = shape == 4 && i > 0 && r() < 0.3 ? next.back().position : static_cast<float>(r());
+        next.push_back(hybrid::car(i, position, 0.0f, 0.0f));
+        if(r() < 0.1)
+            next.back().other_lane_membership.other_lane = &other;
+    }
+
+    const size_t arrivals = shape == 2 || shape == 3 ? std::min(n, static_cast<size_t>(1 + 4*r())) : 0;
+    switch(shape)
+    {
+    case 0:
+    case 2:
+        std::sort(next.begin(), next.end() - arrivals, position_less());
+        break;
+    case 1:
+    case 3:
+        std::sort(next.begin(), next.end() - arrivals, position_less());
+        std::reverse(next.begin(), next.end() - arrivals);
+        break;
+    }
+}
+
+// car_swap against a std::sort of the same cars: every car kept, in position order, and merging_in indexing the merging ones
+static bool car_swap_sorts()
+{
+    static const int    NLANES  = 2000;
+    static const size_t SIZES[] = { 0, 1, 2, 3, 17, 250 };
+
+    hybrid::rand_stream r(42, 0, 0, 0);
+
+    bool   ok    = true;
+    size_t lanes = 0;
+    for(int n = 0; n < NLANES; ++n)
+    {
+        BOOST_FOREACH(const size_t size, SIZES)
+        {
+            hybrid::lane l;
+            make_next_cars(l, r, n % 5, size);
+
+            std::vector<hybrid::car> sorted(l.next_cars());
+            std::sort(sorted.begin(), sorted.end(), position_less());
+
+            l.car_swap();
+            std::vector<hybrid::car> &swapped = l.current_cars();
+
+            ok = ok && l.next_cars().empty() && swapped.size() == sorted.size();
+            for(size_t i = 0; ok && i < sorted.size(); ++i)
+                ok = swapped[i].position == sorted[i].position;
+
+            std::vector<size_t> merging;
+            for(size_t i = 0; i < swapped.size(); ++i)
+            {
+                if(swapped[i].other_lane_membership.other_lane)
+                    merging.push_back(i);
+            }
+            ok = ok && merging == l.merging_in;
+
+            std::sort(swapped.begin(), swapped.end(), id_less());
+            for(size_t i = 0; ok && i < swapped.size(); ++i)
+                ok = swapped[i].id == i;
+            ++lanes;
+        }
+    }
+
+    std::cout << "car_swap: " << lanes << " lanes" << (ok ? "" : " MISMATCH") << std::endl;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = car_swap_sorts();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
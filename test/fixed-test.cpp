@@ -0,0 +1,86 @@
+#include "sim-test.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+// cells long enough that macro_step takes max_dt too; lanes from three cells to past two bands
+// wide, and a tile short enough that the longer ones take several, with a pass left over at the end
+static void setup(hybrid::simulator &s)
+{
+    test_initialize(s, 18.0f, 0.3/s.car_length);
+    s.fixed_block = 8;
+    s.fixed_tile  = 7;
+}
+
+// macro_fixed_run against as many macro_step at the same dt: the same cells, step and time
+static bool fixed_matches()
+{
+    static const int   NSTEPS = 50;
+    static const float DT     = 0.5f;
+
+    hwm::network      net_fixed(test_network("loop.xml"));
+    hybrid::simulator fixed(&net_fixed, 4.5f, 1.0);
+    setup(fixed);
+
+    hwm::network      net_step(test_network("loop.xml"));
+    hybrid::simulator step(&net_step, 4.5f, 1.0);
+    setup(step);
+
+    fixed.macro_fixed_run(NSTEPS, DT);
+    bool ok = true;
+    for(int i = 0; i < NSTEPS; ++i)
+    {
+        ok = ok && step.macro_step(1.0f) == DT;
+        step.time += DT;
+        ++step.step;
+    }
+
+    size_t tiled = 0;
+    float  worst = 0.0f;
+    for(size_t i = 0; i < fixed.lanes.size(); ++i)
+    {
+        const hybrid::lane &a = fixed.lanes[i];
+        const hybrid::lane &b = step.lanes[i];
+        if(a.N > 2*static_cast<size_t>(fixed.fixed_block))
+            ++tiled;
+        for(size_t j = 0; j < a.N; ++j)
+            worst = std::max(worst, std::max(std::abs(a.q[j].rho() - b.q[j].rho()), std::abs(a.q[j].y() - b.q[j].y())));
+    }
+    ok = ok && fixed.step == step.step && std::abs(fixed.time - step.time) <= 1e-4f*step.time && worst < 1e-5f && tiled > 0;
+
+    std::cout << "macro_fixed_run: " << fixed.step << " steps of " << DT << " s, " << tiled << " lanes tiled, cells off by up to "
+              << worst << std::endl;
+    return ok;
+}
+
+// a micro lane would need cars emitted into it and its ends as ghosts, which a pass has neither of
+static bool fixed_micro_throws()
+{
+    hwm::network      net(test_network("loop.xml"));
+    hybrid::simulator s(&net, 4.5f, 1.0);
+    setup(s);
+    test_micro(s, s.lanes[1], 0.3/s.car_length, 15.0f);
+
+    bool threw = false;
+    try
+    {
+        s.macro_fixed_run(1, 0.5f);
+    }
+    catch(const std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    std::cout << "macro_fixed_run with a micro lane: " << (threw ? "threw" : "DIDN'T THROW") << std::endl;
+    return threw && s.step == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = fixed_matches()      && ok;
+    ok = fixed_micro_throws() && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
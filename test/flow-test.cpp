@@ -0,0 +1,83 @@
+#include "sim-test.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+
+static const int NSTEPS = 50;
+
+// cells long enough that the rate bounds allow the most macro_step takes, so both step by the same dt
+static void setup(hybrid::simulator &s)
+{
+    test_initialize(s, 18.0f, 0.3/s.car_length);
+}
+
+// macro_flow_run against as many macro_step: the same cells, with the step and time advanced the same
+static bool flow_matches()
+{
+    hwm::network      net_flow(test_network("loop.xml"));
+    hybrid::simulator flow(&net_flow, 4.5f, 1.0);
+    setup(flow);
+
+    hwm::network      net_step(test_network("loop.xml"));
+    hybrid::simulator step(&net_step, 4.5f, 1.0);
+    setup(step);
+
+    const float dt = flow.macro_flow_run(NSTEPS);
+    for(int i = 0; i < NSTEPS; ++i)
+    {
+        if(step.macro_step(1.0f) != dt)
+            return false;
+        step.time += dt;
+        ++step.step;
+    }
+
+    bool  ok    = flow.step == step.step && std::abs(flow.time - step.time) <= 1e-4f*step.time;
+    float worst = 0.0f;
+    for(size_t i = 0; i < flow.lanes.size(); ++i)
+    {
+        const hybrid::lane &a = flow.lanes[i];
+        const hybrid::lane &b = step.lanes[i];
+        for(size_t j = 0; j < a.N; ++j)
+            worst = std::max(worst, std::max(std::abs(a.q[j].rho() - b.q[j].rho()), std::abs(a.q[j].y() - b.q[j].y())));
+    }
+    ok = ok && worst < 1e-5f;
+
+    std::cout << "macro_flow_run: " << flow.step << " steps of " << dt << " s, cells off by up to " << worst << std::endl;
+    return ok;
+}
+
+// a cell with y > 0, which fix() never leaves, moves faster than its speed limit and outruns the rate bound
+static bool flow_overrun_throws()
+{
+    hwm::network      net(test_network("loop.xml"));
+    hybrid::simulator s(&net, 4.5f, 1.0);
+    setup(s);
+
+    hybrid::lane &l = s.lanes[0];
+    l.q[l.N/2]     = arz<float>::q(0.5f, 0.0f);
+    l.q[l.N/2].y() = 5.0f*l.speedlimit();
+    l.find_wet();
+
+    bool threw = false;
+    try
+    {
+        s.macro_flow_run(1);
+    }
+    catch(const std::runtime_error &)
+    {
+        threw = true;
+    }
+
+    std::cout << "macro_flow_run past the rate bound: " << (threw ? "threw" : "DIDN'T THROW") << std::endl;
+    return threw;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = flow_matches()        && ok;
+    ok = flow_overrun_throws() && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -383,7 +383,7 @@ public:
                         else
                             std::cout << "Lane: " << l.parent->id << "empty. (no first)" << std::endl;
 
-                        if(l.macro_find_last(pos, *sim))
+                        if(l.macro_find_last(pos, *sim, sim->step, 0))
                             std::cout << "Lane: " << l.parent->id << "last at " << pos << std::endl;
                         else
                             std::cout << "Lane: " << l.parent->id << "empty. (no last)" << std::endl;
@@ -468,7 +468,7 @@ int main(int argc, char *argv[])
         for (int i = 0; i < cars_per_lane; i++)
         {
             //TODO Just creating some cars here...
-            l.current_cars().push_back(s.make_car(p, 10, 0));
+            l.current_cars().push_back(s.make_car(l, p, 10, 0));
 
             //Cars need a minimal distance spacing
             p += (25.0 * l.inv_length);
@@ -487,7 +487,7 @@ int main(int argc, char *argv[])
         for (int i = 0; i < cars_per_lane; i++)
         {
             //TODO Just creating some cars here...
-            l.current_cars().push_back(s.make_car(p, 0, 0));
+            l.current_cars().push_back(s.make_car(l, p, 0, 0));
 
             //Cars need a minimal distance spacing
             p += (6.0 * l.inv_length);
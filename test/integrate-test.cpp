@@ -0,0 +1,72 @@
+#include "libhybrid/hybrid-sim.hpp"
+#include <iostream>
+#include <cmath>
+
+// the same arithmetic, but the compiler may fuse it differently in the two loops
+static bool close(const float a, const float b)
+{
+    return std::abs(a - b) <= 1e-6f*std::max(1.0f, std::abs(b));
+}
+
+// lane::integrate_cars against car::integrate on each car, with some of them merging in from a neighbour
+static bool integrate_matches()
+{
+    static const int   NLANES   = 100;
+    static const int   NCARS    = 200;
+    static const float TIMESTEP = 0.033f;
+    static const float WIDTH    = 2.5f;
+
+    hybrid::rand_stream r(42, 0, 0, 0);
+    hybrid::lane        other;
+    other.inv_length = 1.0f/300.0f;
+
+    bool ok = true;
+    for(int n = 0; n < NLANES; ++n)
+    {
+        hybrid::lane l;
+        l.length     = 100.0f + 1000.0f*r();
+        l.inv_length = 1.0f/l.length;
+        for(int i = 0; i < NCARS; ++i)
+        {
+            hybrid::car c(i, (i + 0.5f)/NCARS, static_cast<float>(30.0*r()), static_cast<float>(-4.0 + 5.0*r()));
+            if(r() < 0.1)
+            {
+                c.other_lane_membership.other_lane  = &other;
+                c.other_lane_membership.is_left     = r() < 0.5;
+                c.other_lane_membership.merge_param = static_cast<float>(r());
+                c.other_lane_membership.position    = static_cast<float>(r());
+            }
+            l.current_cars().push_back(c);
+        }
+        l.index_cars();
+
+        std::vector<hybrid::car> each(l.current_cars());
+        BOOST_FOREACH(hybrid::car &c, each)
+        {
+            c.integrate(TIMESTEP, l, WIDTH);
+        }
+        l.integrate_cars(TIMESTEP, WIDTH);
+
+        for(int i = 0; i < NCARS; ++i)
+        {
+            const hybrid::car &a = l.current_car(i);
+            const hybrid::car &b = each[i];
+            ok = ok && close(a.position, b.position) && close(a.velocity, b.velocity)
+                && a.other_lane_membership.other_lane == b.other_lane_membership.other_lane
+                && close(a.other_lane_membership.merge_param, b.other_lane_membership.merge_param)
+                && close(a.other_lane_membership.position,    b.other_lane_membership.position)
+                && close(a.other_lane_membership.theta,       b.other_lane_membership.theta);
+        }
+    }
+
+    std::cout << "integrate_cars: " << NLANES*NCARS << " cars" << (ok ? "" : " MISMATCH") << std::endl;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = integrate_matches();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
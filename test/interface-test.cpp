@@ -0,0 +1,54 @@
+#include "sim-test.hpp"
+#include <iostream>
+#include <cmath>
+
+// Each speed limit change on the ring solved from both sides, as solve_downstream_end on the
+// upstream lane and solve_upstream_end on the downstream one, for states from vacuum to jammed:
+// both read the upstream cell by its own lane's speed limit, so they find the same fastest wave
+static bool interface_speeds()
+{
+    static const int NSTATES = 2000;
+
+    hwm::network      net(test_network("ring.xml"));
+    hybrid::simulator s(&net, 4.5f, 1.0);
+    test_initialize(s, 4.1*4.5, 0.25/s.car_length);
+
+    hybrid::rand_stream r(42, 0, 0, 0);
+    float               storage[2][arz_streams::nstreams];
+    arz_streams         up_cells(storage[0], 1);
+    arz_streams         down_cells(storage[1], 1);
+
+    double worst  = 0.0;
+    size_t solved = 0;
+    BOOST_FOREACH(const hybrid::lane *up, s.macro_lanes)
+    {
+        const hybrid::lane *down = s.lane_at(s.link(*up).downstream);
+        if(!down || down->speedlimit() == up->speedlimit())
+            continue;
+
+        for(int i = 0; i < NSTATES; ++i)
+        {
+            const arz<float>::q last(static_cast<float>(r()), static_cast<float>(r()*up->speedlimit()), up->speedlimit());
+            const arz<float>::q first(static_cast<float>(r()), static_cast<float>(r()*down->speedlimit()), down->speedlimit());
+            up_cells.fill(&last, 1, up->speedlimit());
+            down_cells.fill(&first, 1, down->speedlimit());
+
+            arz<float>::q flux;
+            const float   from_up   = up->solve_downstream_end(s, up_cells, 0, first, flux);
+            const float   from_down = down->solve_upstream_end(s, down_cells, last, flux);
+            worst = std::max(worst, std::abs(static_cast<double>(from_up - from_down))/std::max(1.0f, from_up));
+            ++solved;
+        }
+    }
+
+    std::cout << "interface speeds: " << solved << " states, off by up to " << worst << std::endl;
+    return worst < 1e-5 && solved > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = interface_speeds();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include "sim-test.hpp"
+#include <iostream>
+#include <cmath>
+
+// Lanes in simulator order: C micro with cars, e empty micro, D dense macro, m empty macro.
+static void set_lanes(hybrid::simulator &s, const char *kinds)
+{
+    for(size_t i = 0; i < s.lanes.size(); ++i)
+    {
+        hybrid::lane &l = s.lanes[i];
+        switch(kinds[i])
+        {
+        case 'C':
+            test_micro(s, l, 0.25/s.car_length, 12.0f);
+            break;
+        case 'e':
+            test_micro(s, l, 0.25/s.car_length, 0.0f);
+            l.current_cars().clear();
+            break;
+        case 'm':
+            l.clear_macro();
+            break;
+        }
+    }
+}
+
+// lookahead::query from build_lookahead's table against lane::distance_to_car's walk, for every
+// lane a micro lane feeds and a few distances already walked, up to the 1000 m find_free_dist_and_vel asks
+static bool lookahead_matches(const char *network, const char *kinds)
+{
+    static const float DISTANCE_MAX = 1000.0f;
+    static const float STARTS[]     = { 0.0f, 37.5f, 420.0f, 990.0f };
+
+    hwm::network      net(test_network(network));
+    hybrid::simulator s(&net, 4.5f, 1.0);
+    test_initialize(s, 4.1*4.5, 0.25/s.car_length);
+    set_lanes(s, kinds);
+
+    s.build_lookahead();
+
+    bool   ok      = true;
+    size_t queries = 0;
+    BOOST_FOREACH(const hybrid::lane *m, s.micro_lanes)
+    {
+        const hybrid::lane_link &ln = s.link(*m);
+        const hybrid::lane      *d  = s.lane_at(ln.downstream);
+        if(ln.end_boundary || !d)
+            continue;
+
+        BOOST_FOREACH(const float start, STARTS)
+        {
+            float walk_dist = start, walk_vel = -1.0f;
+            d->distance_to_car(walk_dist, walk_vel, DISTANCE_MAX, s);
+
+            float table_dist = start, table_vel = -1.0f;
+            const bool answered = d->ahead.query(table_dist, table_vel, DISTANCE_MAX);
+
+            ok = ok && answered && std::abs(table_dist - walk_dist) < 1e-3f*DISTANCE_MAX && table_vel == walk_vel;
+            ++queries;
+        }
+    }
+
+    std::cout << "lookahead on " << network << " as " << kinds << ": " << queries << " queries" << (ok ? "" : " MISMATCH") << std::endl;
+    return ok && queries > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = lookahead_matches("ring.xml", "CeDmeC")    && ok; // cars, empty lanes of both kinds and a macro front
+    ok = lookahead_matches("ring.xml", "Cemmee")    && ok; // no vehicle left; the walk goes round the ring
+    ok = lookahead_matches("ring.xml", "eeeeee")    && ok; // every lane asks, and every walk loops
+    ok = lookahead_matches("single-lane.xml", "Ce") && ok; // the chain ends at the network boundary
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include "libhybrid/hybrid-sim.hpp"
+#include <iostream>
+
+// The linear scans find_next_car and get_merging_leader used to do, over every car of the lane
+static const hybrid::car &scan_next_car(const hybrid::lane &l, const float param)
+{
+    for(size_t i = 0; i < l.current_cars().size(); ++i)
+    {
+        if(l.current_car(i).position >= param)
+            return l.current_car(i);
+    }
+    return l.current_cars().back();
+}
+
+static hybrid::car scan_merging_leader(const hybrid::lane &l, const float param, const hybrid::lane *other_lane)
+{
+    hybrid::car found(-1, -1, -1, -1);
+    for(size_t i = 0; i < l.current_cars().size(); ++i)
+    {
+        const hybrid::car &c = l.current_car(i);
+        if(c.other_lane_membership.other_lane == other_lane && c.position >= param)
+        {
+            found          = c;
+            found.position = c.other_lane_membership.position;
+        }
+    }
+    return found;
+}
+
+// Lanes of NCARS cars, a few on the same spot, some of them merging in from one of two
+// neighbours, put in place by car_swap; the binary search and the merging_in index against the scans
+static bool neighbour_queries()
+{
+    static const int NLANES  = 50;
+    static const int NCARS   = 200;
+    static const int NPARAMS = 500;
+
+    hybrid::rand_stream r(42, 0, 0, 0);
+    hybrid::lane        others[2];
+
+    bool   ok      = true;
+    size_t queries = 0;
+    for(int n = 0; n < NLANES; ++n)
+    {
+        hybrid::lane l;
+        const double merging = 0.5*r();
+        for(int i = 0; i < NCARS; ++i)
+        {
+            const float position = r() < 0.1 && i > 0 ? l.next_car(i - 1).position : static_cast<float>(r());
+            hybrid::car c(i, position, static_cast<float>(30.0*r()), 0.0f);
+            if(r() < merging)
+            {
+                c.other_lane_membership.other_lane = &others[r() < 0.5];
+                c.other_lane_membership.position   = static_cast<float>(r());
+            }
+            l.next_cars().push_back(c);
+        }
+        l.car_swap();
+
+        const float last = l.current_cars().back().position;
+        for(int p = 0; p < NPARAMS; ++p)
+        {
+            const float param = p % 10 ? static_cast<float>(last*r()) : l.current_car(static_cast<size_t>(r()*NCARS)).position;
+
+            ok = ok && l.find_next_car(param).id == scan_next_car(l, param).id;
+            for(int o = 0; o < 2; ++o)
+            {
+                const hybrid::car fast = l.get_merging_leader(param, &others[o]);
+                const hybrid::car slow = scan_merging_leader(l, param, &others[o]);
+                ok = ok && fast.id == slow.id && fast.position == slow.position && fast.velocity == slow.velocity;
+            }
+            ++queries;
+        }
+    }
+
+    std::cout << "neighbour queries: " << queries << (ok ? "" : " MISMATCH") << std::endl;
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = neighbour_queries();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include "libhybrid/partition.hpp"
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+// NPARTS grids joined in a ring by one edge each: every vertex placed, parts in balance, the cut
+// as reported and the same every time, and the grids found, so only the ring's edges are cut
+static bool partition_clusters()
+{
+    static const int   SIDE      = 16;
+    static const int   NPARTS    = 4;
+    static const float IMBALANCE = 0.05f;
+
+    hybrid::partition_graph g;
+    g.vwgt.assign(NPARTS*SIDE*SIDE, 1);
+    std::vector<std::pair<int, int> > edges;
+    for(int c = 0; c < NPARTS; ++c)
+    {
+        const int base = c*SIDE*SIDE;
+        for(int y = 0; y < SIDE; ++y)
+        {
+            for(int x = 0; x < SIDE; ++x)
+            {
+                if(x + 1 < SIDE)
+                    edges.push_back(std::make_pair(base + y*SIDE + x, base + y*SIDE + x + 1));
+                if(y + 1 < SIDE)
+                    edges.push_back(std::make_pair(base + y*SIDE + x, base + (y + 1)*SIDE + x));
+            }
+        }
+        edges.push_back(std::make_pair(base + SIDE*SIDE - 1, ((c + 1) % NPARTS)*SIDE*SIDE));
+    }
+    g.build(edges);
+
+    std::vector<int> part, again;
+    const long cut = hybrid::partition(g, NPARTS, IMBALANCE, part);
+    hybrid::partition(g, NPARTS, IMBALANCE, again);
+
+    bool ok = part.size() == g.nvertices() && part == again && cut == hybrid::edge_cut(g, part);
+
+    std::vector<long> weight(NPARTS, 0);
+    for(size_t v = 0; v < part.size() && ok; ++v)
+    {
+        if(part[v] < 0 || part[v] >= NPARTS)
+            ok = false;
+        else
+            weight[part[v]] += g.vwgt[v];
+    }
+    const long limit = static_cast<long>(std::ceil((1.0f + IMBALANCE)*SIDE*SIDE));
+    for(int p = 0; p < NPARTS && ok; ++p)
+        ok = weight[p] <= limit;
+
+    std::cout << "partition: " << NPARTS << " " << SIDE << "x" << SIDE << " grids in a ring, cut " << cut << std::endl;
+    return ok && cut == NPARTS;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = partition_clusters();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
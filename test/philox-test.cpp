@@ -0,0 +1,71 @@
+#include "libhybrid/philox.hpp"
+#include <iostream>
+#include <cmath>
+
+// Philox4x32-10 known answers, from the Random123 distribution's kat_vectors
+static bool philox_kat()
+{
+    static const uint32_t kat[3][10] = {
+        { 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+          0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+          0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+        { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0,
+          0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+    };
+
+    bool ok = true;
+    for(int i = 0; i < 3; ++i)
+    {
+        uint32_t out[4];
+        hybrid::philox4x32::block(out, kat[i], kat[i] + 4);
+        for(int j = 0; j < 4; ++j)
+        {
+            if(out[j] != kat[i][6 + j])
+            {
+                std::cerr << "philox4x32-10 vector " << i << " word " << j << ": got " << std::hex << out[j]
+                          << ", want " << kat[i][6 + j] << std::dec << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+// rand_stream: the same key always gives the same draws, whatever else was drawn in between,
+// changing any part of the key changes them, and every draw is in (0, 1)
+static bool stream_keys()
+{
+    static const int NDRAWS = 100000;
+
+    hybrid::rand_stream a(42, 7, 100, 3);
+    hybrid::rand_stream b(42, 7, 100, 3);
+    hybrid::rand_stream others[4] = { hybrid::rand_stream(43, 7, 100, 3), hybrid::rand_stream(42, 8, 100, 3),
+                                      hybrid::rand_stream(42, 7, 101, 3), hybrid::rand_stream(42, 7, 100, 4) };
+
+    bool   ok    = true;
+    int    same  = 0;
+    double total = 0.0;
+    for(int i = 0; i < NDRAWS; ++i)
+    {
+        const double u = a();
+        for(int j = 0; j < 4; ++j)
+            same += others[j]() == u;
+        ok     = ok && u > 0.0 && u < 1.0 && u == b();
+        total += u;
+    }
+
+    const double mean = total/NDRAWS;
+    std::cout << "rand_stream: mean of " << NDRAWS << " draws " << mean << ", " << same << " shared with other keys" << std::endl;
+    return ok && same == 0 && std::abs(mean - 0.5) < 0.01;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = philox_kat()  && ok;
+    ok = stream_keys() && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
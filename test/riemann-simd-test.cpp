@@ -0,0 +1,70 @@
+#include "libhybrid/arz-simd.hpp"
+#include "libhybrid/philox.hpp"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// arz_fluctuation_sweep, which goes simd::vfloat::width interfaces at a time, against riemann_solution::riemann one at a time
+static bool riemann_equivalence()
+{
+    static const size_t N         = 100003;
+    static const float  u_max     = 30.0f;
+    static const float  inv_u_max = 1.0f/u_max;
+    static const double TOLERANCE = 1e-4;
+
+    // vacuum, near-vacuum, runs of equal cells and everything else
+    hybrid::rand_stream        r(42, 0, 0, 0);
+    std::vector<arz<float>::q> q(N);
+    for(size_t i = 0; i < N; ++i)
+    {
+        const double kind = r();
+        const float  rho  = kind < 0.2 ? 0.0f : (kind < 0.3 ? static_cast<float>(1e-5*r()) : static_cast<float>(0.95*r()));
+        const float  u    = static_cast<float>(u_max*r());
+        q[i] = arz<float>::q(rho, std::min(arz<float>::eq::y(rho, u, u_max), 0.0f));
+        if(i > 0 && r() < 0.1)
+            q[i] = q[i-1];
+        q[i].fix();
+    }
+
+    std::vector<float> storage(arz_streams::nstreams*N);
+    arz_streams s(&storage[0], N);
+    s.fill(&q[0], N, u_max);
+    s.drho[0] = 0.0f;
+    s.dy[0]   = 0.0f;
+    const float maxspeed = arz_fluctuation_sweep(s, 1, N, u_max, inv_u_max);
+
+    std::vector<arz<float>::riemann_solution> rs(N + 1);
+    float ref_maxspeed = 0.0f;
+    for(size_t i = 1; i < N; ++i)
+    {
+        const arz<float>::full_q left(q[i-1], u_max);
+        const arz<float>::full_q right(q[i], u_max);
+        rs[i].riemann(left, right, u_max, inv_u_max);
+        ref_maxspeed = std::max(ref_maxspeed, std::max(std::abs(rs[i].speeds[0]), std::abs(rs[i].speeds[1])));
+    }
+
+    double maxerr = 0.0;
+    for(size_t i = 0; i < N; ++i)
+    {
+        for(int c = 0; c < 2; ++c)
+        {
+            const float ref = (i > 0 ? rs[i].right_fluctuation[c] : 0.0f) + (i + 1 < N ? rs[i+1].left_fluctuation[c] : 0.0f);
+            const float got = c == 0 ? s.drho[i] : s.dy[i];
+            maxerr          = std::max(maxerr, std::abs(ref - got)/(1.0 + std::abs(ref)));
+        }
+    }
+    const double speederr = std::abs(maxspeed - ref_maxspeed)/(1.0 + ref_maxspeed);
+
+    std::cout << "riemann: " << simd::vfloat::width << "-wide sweep, max fluctuation error " << maxerr
+              << ", max speed error " << speederr << std::endl;
+    return maxerr <= TOLERANCE && speederr <= TOLERANCE;
+}
+
+int main(int argc, char *argv[])
+{
+    const bool ok = riemann_equivalence();
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "sim-test.hpp"
+#include <iostream>
+#include <limits>
+#include <cmath>
+
+static const float TIMESTEP  = 0.033f;
+static const float EPSILON   = 1;
+static const float EPSILON_2 = 0.01;
+
+// The settle pass as it was, recomputing the whole lane for every iteration of every car; except that
+// where it read past the end after dropping the front car, this moves on to the car behind, as settle_pass does
+static void scan_settle_pass(hybrid::lane &l, const hybrid::simulator &sim)
+{
+    int i = static_cast<int>(l.current_cars().size())-1;
+    while(!l.current_cars().empty() && i >= 0)
+    {
+        hybrid::car &c = l.current_car(i);
+
+        float last_acceleration = std::numeric_limits<float>::max();
+        while(true)
+        {
+            l.compute_lane_accelerations(TIMESTEP, sim);
+
+            c.velocity = std::max(c.velocity + c.acceleration * TIMESTEP,
+                                  0.0f);
+
+            if( std::abs(c.acceleration) > std::abs(last_acceleration)
+                || c.position+sim.front_bumper_offset()*l.inv_length >= 1.0
+                || ((std::abs(c.acceleration - last_acceleration) < EPSILON_2) && (std::abs(c.acceleration) > EPSILON)))
+            {
+                l.current_cars().erase(l.current_cars().begin() + i);
+                i = std::min(i, static_cast<int>(l.current_cars().size())-1);
+                break;
+            }
+            else if(std::abs(c.acceleration) < EPSILON)
+            {
+                --i;
+                break;
+            }
+
+            last_acceleration = c.acceleration;
+        }
+    }
+}
+
+static bool same_cars(const std::vector<hybrid::car> &a, const std::vector<hybrid::car> &b)
+{
+    if(a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); ++i)
+    {
+        if(a[i].id != b[i].id || a[i].position != b[i].position || std::abs(a[i].velocity - b[i].velocity) > 1e-4f)
+            return false;
+    }
+    return true;
+}
+
+static void populate(hybrid::simulator &s)
+{
+    test_initialize(s, 4.1*4.5, 0.25/s.car_length);
+    BOOST_FOREACH(hybrid::lane &l, s.lanes)
+    {
+        test_micro(s, l, 0.6/s.car_length, 15.0f);
+    }
+}
+
+// One pass over every lane, from the same lookahead, against the scan: the same cars kept at the same velocities
+static bool settle_pass_matches()
+{
+    hwm::network      net(test_network("ring.xml"));
+    hybrid::simulator s(&net, 4.5f, 1.0);
+    populate(s);
+
+    s.build_lookahead();
+
+    bool   ok      = true;
+    size_t settled = 0;
+    BOOST_FOREACH(hybrid::lane *l, s.micro_lanes)
+    {
+        const std::vector<hybrid::car> before(l->current_cars());
+
+        scan_settle_pass(*l, s);
+        const std::vector<hybrid::car> scanned(l->current_cars());
+
+        l->current_cars() = before;
+        l->settle_pass(TIMESTEP, EPSILON, EPSILON_2, s);
+
+        ok       = ok && same_cars(l->current_cars(), scanned);
+        settled += scanned.size();
+    }
+
+    std::cout << "settle pass: " << settled << " cars kept" << (ok ? "" : " MISMATCH") << std::endl;
+    return ok && settled > 0;
+}
+
+// simulator::settle on one thread and on several: lanes settle in parallel, but against the
+// lookahead built before each pass, so how they are spread over threads doesn't matter
+static bool settle_threads()
+{
+    hwm::network net_one(test_network("ring.xml"));
+    omp_set_num_threads(1);
+    hybrid::simulator one(&net_one, 4.5f, 1.0);
+    populate(one);
+    one.settle(TIMESTEP);
+
+    hwm::network net_many(test_network("ring.xml"));
+    omp_set_num_threads(4);
+    hybrid::simulator many(&net_many, 4.5f, 1.0);
+    populate(many);
+    many.settle(TIMESTEP);
+
+    bool ok = one.pool->size() == 1 && many.pool->size() == 4;
+    for(size_t i = 0; i < one.lanes.size(); ++i)
+        ok = ok && same_cars(one.lanes[i].current_cars(), many.lanes[i].current_cars());
+
+    std::cout << "settle: " << one.ncars() << " cars on 1 thread, " << many.ncars() << " on 4" << std::endl;
+    return ok && one.ncars() > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+    ok = settle_pass_matches() && ok;
+    ok = settle_threads()      && ok;
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
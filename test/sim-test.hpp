@@ -0,0 +1,52 @@
+#ifndef _SIM_TEST_HPP_
+#define _SIM_TEST_HPP_
+
+#include "libhybrid/hybrid-sim.hpp"
+#include <cstdlib>
+
+// Setup shared by the test programs that run a simulator on one of the networks in this directory.
+
+// Load a network from this directory, wherever make check runs the test from.
+inline hwm::network test_network(const char *name)
+{
+    const char *srcdir = std::getenv("srcdir");
+    const str   path   = str(srcdir ? srcdir : ".") + "/" + name;
+
+    hwm::network net(hwm::load_xml_network(path.c_str(), vec3f(1.0, 1.0, 1.0f)));
+    net.build_intersections();
+    net.build_fictitious_lanes();
+    net.auto_scale_memberships();
+    net.center();
+    net.check();
+    return net;
+}
+
+// The parameters test/hybrid.cpp runs with; every lane macro, with the density of cars populate() places at rate.
+inline void test_initialize(hybrid::simulator &s, const float h_suggest, const float rate)
+{
+    s.micro_initialize(0.73,
+                       1.67,
+                       33,
+                       4);
+    s.macro_initialize(h_suggest, 0.0f);
+
+    BOOST_FOREACH(hybrid::lane &l, s.lanes)
+    {
+        l.sim_type = hybrid::MICRO;
+        l.populate(rate, s);
+        s.convert_to_macro(l);
+    }
+}
+
+// Make a lane micro, with cars placed at rate, all going velocity.
+inline void test_micro(hybrid::simulator &s, hybrid::lane &l, const float rate, const float velocity)
+{
+    s.convert_to_micro(l);
+    l.populate(rate, s);
+    BOOST_FOREACH(hybrid::car &c, l.current_cars())
+    {
+        c.velocity = velocity;
+    }
+}
+
+#endif